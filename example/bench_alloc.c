@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jsonrpc.h>
+#include <jsonrpc_plugin_insitu.h>
+#include <jsonrpc_plugin_simd.h>
+
+#define	ROUNDS			200000
+#define	POOL_CLASSES	13		///< 16 bytes .. 64 KB
+#define	ARENA_BLOCK		(1024 * 1024)
+
+/**
+ * allocator that counts its calls
+ */
+typedef struct
+{
+	const char		*name;
+	jsonrpc_allocator_t	allocator;
+	unsigned long	calls;
+} bench_alloc_t;
+
+/**
+ * header in front of the blocks of the pool and the arena
+ */
+typedef union
+{
+	size_t			size;
+	double			align;
+} block_t;
+
+
+static void * heap_malloc (size_t n, void *userdata)
+{
+	((bench_alloc_t *)userdata)->calls++;
+	return malloc(n);
+}
+
+static void * heap_realloc (void *mem, size_t n, void *userdata)
+{
+	((bench_alloc_t *)userdata)->calls++;
+	return realloc(mem, n);
+}
+
+static void heap_free (void *mem, void *userdata)
+{
+	((bench_alloc_t *)userdata)->calls++;
+	free(mem);
+}
+
+
+/*
+ * pool: free lists of power-of-2 size classes, bigger blocks from the heap
+ */
+static block_t	*s_pool[POOL_CLASSES];
+
+static size_t pool_class (size_t n)
+{
+	size_t	c = 0;
+
+	while (((size_t)16 << c) < n)
+		c++;
+	return c;
+}
+
+static void * pool_malloc (size_t n, void *userdata)
+{
+	bench_alloc_t	*self = (bench_alloc_t *)userdata;
+	size_t	c = pool_class(n);
+	block_t	*block;
+
+	self->calls++;
+	if (c < POOL_CLASSES && s_pool[c])
+	{
+		block = s_pool[c];
+		s_pool[c] = *(block_t **)(block + 1);
+	}
+	else
+	{
+		n = (c < POOL_CLASSES) ? ((size_t)16 << c) : n;
+		block = (block_t *)malloc(sizeof(block_t) + n);
+		if (block == NULL)
+			return NULL;
+	}
+	block->size = c;
+	return block + 1;
+}
+
+static void pool_free (void *mem, void *userdata)
+{
+	block_t	*block;
+
+	((bench_alloc_t *)userdata)->calls++;
+	if (mem == NULL)
+		return;
+	block = (block_t *)mem - 1;
+	if (block->size < POOL_CLASSES)
+	{
+		*(block_t **)mem = s_pool[block->size];
+		s_pool[block->size] = block;
+	}
+	else
+		free(block);
+}
+
+static void * pool_realloc (void *mem, size_t n, void *userdata)
+{
+	block_t	*block;
+	size_t	size;
+	void	*grown;
+
+	if (mem == NULL)
+		return pool_malloc(n, userdata);
+	block = (block_t *)mem - 1;
+	if (block->size < POOL_CLASSES && n <= ((size_t)16 << block->size))
+		return mem;
+	if ((grown = pool_malloc(n, userdata)) == NULL)
+		return NULL;
+	size = (block->size < POOL_CLASSES) ? ((size_t)16 << block->size) : n;
+	memcpy(grown, mem, size < n ? size : n);
+	pool_free(mem, userdata);
+	return grown;
+}
+
+
+/*
+ * arena: bump allocation, nothing is ever given back
+ */
+static char		*s_arena;
+static size_t	s_arena_used = ARENA_BLOCK;
+
+static void * arena_malloc (size_t n, void *userdata)
+{
+	bench_alloc_t	*self = (bench_alloc_t *)userdata;
+	block_t	*block;
+	size_t	need = sizeof(block_t) + ((n + sizeof(block_t) - 1) & ~(sizeof(block_t) - 1));
+
+	self->calls++;
+	if (s_arena_used + need > ARENA_BLOCK)
+	{
+		if ((s_arena = (char *)malloc(need > ARENA_BLOCK ? need : ARENA_BLOCK)) == NULL)
+			return NULL;
+		s_arena_used = 0;
+	}
+	block = (block_t *)(s_arena + s_arena_used);
+	block->size = n;
+	s_arena_used += need;
+	return block + 1;
+}
+
+static void arena_free (void *mem, void *userdata)
+{
+	(void)mem;
+	((bench_alloc_t *)userdata)->calls++;
+}
+
+static void * arena_realloc (void *mem, size_t n, void *userdata)
+{
+	size_t	size;
+	void	*grown;
+
+	if (mem == NULL)
+		return arena_malloc(n, userdata);
+	size = ((block_t *)mem - 1)->size;
+	if ((grown = arena_malloc(n, userdata)) == NULL)
+		return NULL;
+	memcpy(grown, mem, size < n ? size : n);
+	return grown;
+}
+
+
+jsonrpc_error_t subtract (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)print_result;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, argv[0].json.u.number - argv[1].json.u.number);
+}
+
+jsonrpc_error_t sum (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	double r = 0.0;
+
+	(void)print_result;
+	while (argc--)
+		r += argv[argc].json.u.number;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, r);
+}
+
+jsonrpc_error_t update (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)argv;
+	(void)print_result;
+	(void)ctx;
+	return JSONRPC_ERROR_OK;
+}
+
+jsonrpc_error_t echo (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)print_result;
+	return jsonrpc_writer_string((jsonrpc_writer_t *)ctx, argv[0].json.u.string, argv[0].json.length);
+}
+
+jsonrpc_error_t get_data (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)argv;
+	print_result(ctx, "[\"hello\",5]");
+	return JSONRPC_ERROR_OK;
+}
+
+/**
+ * the calls of example/test.c: positional and named params, notifications, errors and batches
+ */
+static const char *s_requests[] = {
+	  "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42, 23], \"id\": 1}"
+	, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": {\"subtrahend\": 23, \"minuend\": 42}, \"id\": 3}"
+	, "{\"jsonrpc\": \"2.0\", \"method\": \"update\", \"params\": [1,2,3,4,5]}"
+	, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\", \"id\": \"1\"}"
+	, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"a\\tb\\u00e9\\ud83d\\ude00\"], \"id\": 10}"
+	, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar, \"params\": \"bar\", \"baz]"
+	, "[1,2,3]"
+	, "["
+		"{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\"},"
+		"{\"jsonrpc\": \"2.0\", \"method\": \"update\", \"params\": [1,2,3,4,5]},"
+		"{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42,23], \"id\": \"2\"},"
+		"{\"foo\": \"boo\"},"
+		"{\"jsonrpc\": \"2.0\", \"method\": \"foo.get\", \"params\": {\"name\": \"myself\"}, \"id\": \"5\"},"
+		"{\"jsonrpc\": \"2.0\", \"method\": \"get_data\", \"id\": \"9\"}"
+	"]"
+};
+
+static jsonrpc_server_t * open_server (const jsonrpc_json_plugin_t *plugin, bench_alloc_t *alloc)
+{
+	jsonrpc_server_t	*server;
+
+	server = jsonrpc_server_open_ex(&alloc->allocator, plugin, NULL);
+	if (server == NULL)
+		return NULL;
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, subtract, "subtract", "minuend:i, subtrahend:i");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, sum, "sum", "iii");
+	jsonrpc_server_register_method(server, JSONRPC_FALSE, update, "update", "iiiii");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, echo, "echo", "s");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, get_data, "get_data", NULL);
+	return server;
+}
+
+/**
+ * a warm server (its scratch memory is reused), then servers from open to close
+ */
+static void bench (const char *plugin_name, const jsonrpc_json_plugin_t *plugin, bench_alloc_t *alloc)
+{
+	jsonrpc_server_t	*server;
+	clock_t		begin, warm, cold;
+	unsigned long	calls;
+	size_t		n = sizeof(s_requests) / sizeof(s_requests[0]);
+	int			i, j;
+
+	if ((server = open_server(plugin, alloc)) == NULL)
+		return;
+	for (i = 0 ; i < (int)n ; i++)
+		jsonrpc_server_execute(server, s_requests[i]);
+
+	calls = alloc->calls;
+	begin = clock();
+	for (i = 0 ; i < ROUNDS ; i++)
+		jsonrpc_server_execute(server, s_requests[(size_t)i % n]);
+	warm  = clock() - begin;
+	calls = alloc->calls - calls;
+	jsonrpc_server_close(server);
+
+	begin = clock();
+	for (i = 0 ; i < ROUNDS / 100 ; i++)
+	{
+		if ((server = open_server(plugin, alloc)) == NULL)
+			return;
+		for (j = 0 ; j < (int)n ; j++)
+			jsonrpc_server_execute(server, s_requests[j]);
+		jsonrpc_server_close(server);
+	}
+	cold = clock() - begin;
+
+	printf("  %-8s %-6s warm %6.1lf ns/request (%.2lf allocator calls), cold %7.2lf us/server\n"
+		, alloc->name, plugin_name
+		, (double)warm * 1e9 / CLOCKS_PER_SEC / ROUNDS, (double)calls / ROUNDS
+		, (double)cold * 1e6 / CLOCKS_PER_SEC / (ROUNDS / 100)
+	);
+}
+
+int main (void)
+{
+	static bench_alloc_t	allocs[] = {
+		  { "malloc", { heap_malloc, heap_realloc, heap_free, NULL }, 0 }
+		, { "pool", { pool_malloc, pool_realloc, pool_free, NULL }, 0 }
+		, { "arena", { arena_malloc, arena_realloc, arena_free, NULL }, 0 }
+	};
+	size_t	i;
+
+	printf("%d requests of the test workload, and %d servers with one round of it\n", ROUNDS, ROUNDS / 100);
+	for (i = 0 ; i < sizeof(allocs) / sizeof(allocs[0]) ; i++)
+	{
+		allocs[i].allocator.userdata = allocs + i;
+		bench("insitu", jsonrpc_plugin_insitu(), allocs + i);
+		bench("simd", jsonrpc_plugin_simd(), allocs + i);
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <jsonrpc.h>
+#include <jsonrpc_plugin_insitu.h>
+
+#define	METHOD_NUM	10000
+#define	CALL_NUM	1000000
+
+jsonrpc_error_t echo (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argv;
+	print_result(ctx, "%d", argc);
+	return JSONRPC_ERROR_OK;
+}
+
+int main (int argc, const char * argv[])
+{
+	jsonrpc_server_t *server;
+	char		name[32];
+	static char	req[METHOD_NUM][128];
+	clock_t		begin, end;
+	int			i;
+
+	(void)argc;
+	(void)argv;
+	server = jsonrpc_server_open(jsonrpc_plugin_insitu(), NULL);
+	if (server == NULL)
+		return 1;
+
+	begin = clock();
+	for (i = 0 ; i < METHOD_NUM ; i++)
+	{
+		sprintf(name, "bench.method%05d", i);
+		if (jsonrpc_server_register_method(server, JSONRPC_TRUE, echo, name, "i") != JSONRPC_ERROR_OK)
+			return 1;
+		sprintf(req[i], "{\"jsonrpc\":\"2.0\",\"method\":\"%s\",\"params\":[%d],\"id\":%d}", name, i, i);
+	}
+	end = clock();
+	printf("register %d methods: %.3lf ms\n", METHOD_NUM, (double)(end - begin) * 1000.0 / CLOCKS_PER_SEC);
+
+	begin = clock();
+	for (i = 0 ; i < CALL_NUM ; i++)
+	{
+		if (jsonrpc_server_execute(server, req[(i % METHOD_NUM) * 7919 % METHOD_NUM]) == NULL)
+			return 1;
+	}
+	end = clock();
+	printf("dispatch %d calls over %d methods: %.1lf ns/call\n", CALL_NUM, METHOD_NUM
+		, (double)(end - begin) * 1e9 / CLOCKS_PER_SEC / CALL_NUM);
+
+	jsonrpc_server_close(server);
+	return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jsonrpc.h>
+#include <jsonrpc_plugin_insitu.h>
+#include <jsonrpc_plugin_simd.h>
+#ifdef JSONRPC_BENCH_YAJL
+#include "../plugins/jsonrpc_plugin_yajl.h"
+#include "../plugins/jsonrpc_plugin_yajl_sax.h"
+#endif
+
+#define	CORPUS_SIZE		(4 * 1024 * 1024)
+#define	REPEAT			10
+
+typedef struct
+{
+	char	*buf;
+	size_t	length;
+} corpus_t;
+
+static void append (corpus_t *c, const char *fmt, ...)
+{
+	va_list	ap;
+
+	va_start(ap, fmt);
+	c->length += vsprintf(c->buf + c->length, fmt, ap);
+	va_end(ap);
+}
+
+/**
+ * a batch of calls with small params
+ */
+static void make_batch (corpus_t *c)
+{
+	int	i;
+
+	append(c, "{\"jsonrpc\":\"2.0\",\"method\":\"batch\",\"params\":[");
+	for (i = 0 ; c->length < CORPUS_SIZE - 256 ; i++)
+	{
+		append(c, "%s{\"jsonrpc\": \"2.0\", \"method\": \"user.update\", \"params\": {\"id\": %d, \"name\": \"user %d\", \"active\": %s}, \"id\": %d}"
+			, i ? ", " : "", i, i, (i & 1) ? "true" : "false", i);
+	}
+	append(c, "]}");
+}
+
+/**
+ * one call with a bulk numeric array
+ */
+static void make_numbers (corpus_t *c)
+{
+	int	i;
+
+	append(c, "{\"jsonrpc\":\"2.0\",\"method\":\"store\",\"params\":[[");
+	for (i = 0 ; c->length < CORPUS_SIZE - 64 ; i++)
+		append(c, "%s%d.%03d", i ? "," : "", i * 7, i % 1000);
+	append(c, "]],\"id\":1}");
+}
+
+/**
+ * one call with long strings (bulk text / base64 payloads)
+ */
+static void make_strings (corpus_t *c)
+{
+	int	i, j;
+
+	append(c, "{\"jsonrpc\":\"2.0\",\"method\":\"upload\",\"params\":[[");
+	for (i = 0 ; c->length < CORPUS_SIZE - 4096 ; i++)
+	{
+		append(c, "%s\"", i ? "," : "");
+		for (j = 0 ; j < 2048 ; j++)
+			c->buf[c->length++] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(i + j * 7) & 63];
+		append(c, "\"");
+	}
+	append(c, "]],\"id\":1}");
+}
+
+/**
+ * visit every value as a handler would
+ */
+static size_t walk (const jsonrpc_json_plugin_t *plugin, jsonrpc_handle_t json)
+{
+	jsonrpc_json_t	value;
+	size_t	i, n, count = 1;
+
+	if (!plugin->valueof(json, &value))
+		return 0;
+	if (value.type == JSONRPC_TYPE_ARRAY || value.type == JSONRPC_TYPE_OBJECT)
+	{
+		for (i = 0, n = plugin->length(json) ; i < n ; i++)
+			count += walk(plugin, plugin->get_at(json, i));
+	}
+	return count;
+}
+
+static void bench (const char *name, const jsonrpc_json_plugin_t *plugin, const corpus_t *c)
+{
+	jsonrpc_handle_t	json;
+	clock_t		begin, parse = 0, visit = 0;
+	size_t		count = 0;
+	int			i;
+
+	for (i = 0 ; i < REPEAT ; i++)
+	{
+		begin = clock();
+		json  = plugin->parse(c->buf);
+		parse += clock() - begin;
+		if (json == NULL)
+		{
+			printf("  %-10s parse error\n", name);
+			return;
+		}
+
+		begin = clock();
+		count = walk(plugin, json);
+		visit += clock() - begin;
+		plugin->release(json);
+	}
+	printf("  %-10s parse %8.1lf MB/s, walk %7.2lf ms (%lu values)\n", name
+		, (double)c->length * REPEAT / (1024 * 1024) / ((double)parse / CLOCKS_PER_SEC)
+		, (double)visit * 1000.0 / CLOCKS_PER_SEC / REPEAT, (unsigned long)count
+	);
+}
+
+int main (void)
+{
+	static const struct {
+		const char *name;
+		void (* make)(corpus_t *c);
+	} corpora[] = {
+		{ "batch", make_batch },
+		{ "numbers", make_numbers },
+		{ "strings", make_strings },
+	};
+	corpus_t	c;
+	size_t		i;
+
+	c.buf = (char *)malloc(CORPUS_SIZE + 1);
+	if (c.buf == NULL)
+		return 1;
+
+	for (i = 0 ; i < sizeof(corpora) / sizeof(corpora[0]) ; i++)
+	{
+		c.length = 0;
+		corpora[i].make(&c);
+		c.buf[c.length] = '\0';
+
+		printf("%s (%lu bytes)\n", corpora[i].name, (unsigned long)c.length);
+		bench("insitu", jsonrpc_plugin_insitu(), &c);
+		bench("simd", jsonrpc_plugin_simd(), &c);
+#ifdef JSONRPC_BENCH_YAJL
+		bench("yajl", jsonrpc_plugin_yajl(), &c);
+		bench("yajl_sax", jsonrpc_plugin_yajl_sax(), &c);
+#endif
+	}
+	free(c.buf);
+	return 0;
+}
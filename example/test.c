@@ -6,208 +6,1062 @@
  */
 
 #include <stdio.h>
-#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <jsonrpc.h>
+#include <jsonrpc_plugin_insitu.h>
+#include <jsonrpc_plugin_simd.h>
+#ifdef JSONRPC_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#ifdef JSONRPC_TEST_YAJL
 #include "../plugins/jsonrpc_plugin_yajl.h"
+#include "../plugins/jsonrpc_plugin_yajl_sax.h"
+#endif
 
 jsonrpc_error_t subtract (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r, f;
-
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
-
-	r = argv[0].json.u.number - argv[1].json.u.number;
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
-	return JSONRPC_ERROR_OK;
+	(void)argc;
+	(void)print_result;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, argv[0].json.u.number - argv[1].json.u.number);
 }
 
 jsonrpc_error_t sum (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r = 0.0, f;
-
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+	double r = 0.0;
 
+	(void)print_result;
 	while (argc--)
 	{
 		r += argv[argc].json.u.number;
 	}
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, r);
+}
 
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
+jsonrpc_error_t get_data (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)argv;
+	print_result(ctx, "[\"hello\",5]");
 	return JSONRPC_ERROR_OK;
 }
 
-jsonrpc_error_t multiply (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+jsonrpc_error_t update (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r, f;
+	(void)argc;
+	(void)argv;
+	(void)print_result;
+	(void)ctx;
+	return JSONRPC_ERROR_OK;
+}
 
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+jsonrpc_error_t foobar (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)argv;
+	(void)print_result;
+	(void)ctx;
+	return JSONRPC_ERROR_OK;
+}
 
-	r = argv[0].json.u.number * argv[1].json.u.number;
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
+jsonrpc_error_t add64 (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	print_result(ctx, "%lld", (long long)(argv[0].json.u.integer + argv[1].json.u.integer));
 	return JSONRPC_ERROR_OK;
 }
 
-jsonrpc_error_t get_data (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+jsonrpc_error_t echo (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+	(void)argc;
+	(void)print_result;
+	return jsonrpc_writer_string((jsonrpc_writer_t *)ctx, argv[0].json.u.string, argv[0].json.length);
+}
 
-	print_result(ctx, "{\"data\":\"abcde\"}");
+jsonrpc_error_t length (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	print_result(ctx, "%lu", (unsigned long)argv[0].json.length);
 	return JSONRPC_ERROR_OK;
 }
 
+jsonrpc_error_t profile (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)print_result;
+	jsonrpc_writer_t *w = (jsonrpc_writer_t *)ctx;
 
+	jsonrpc_writer_begin_object(w);
+	jsonrpc_writer_key(w, "name");
+	jsonrpc_writer_string(w, argv[0].json.u.string, argv[0].json.length);
+	jsonrpc_writer_key(w, "id");
+	jsonrpc_writer_int64(w, INT64_MIN);
+	jsonrpc_writer_key(w, "score");
+	jsonrpc_writer_number(w, 0.5);
+	jsonrpc_writer_key(w, "tags");
+	jsonrpc_writer_begin_array(w);
+	jsonrpc_writer_string(w, "a", 1);
+	jsonrpc_writer_boolean(w, JSONRPC_TRUE);
+	jsonrpc_writer_null(w);
+	jsonrpc_writer_begin_object(w);
+	jsonrpc_writer_end_object(w);
+	jsonrpc_writer_raw(w, "[1,2]", 5);
+	jsonrpc_writer_end_array(w);
+	return jsonrpc_writer_end_object(w);
+}
 
-jsonrpc_error_t update (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+jsonrpc_error_t unbalanced (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+	(void)argc;
+	(void)argv;
+	(void)print_result;
+	jsonrpc_writer_begin_array((jsonrpc_writer_t *)ctx);
+	jsonrpc_writer_end_object((jsonrpc_writer_t *)ctx);
+	return JSONRPC_ERROR_OK;
+}
 
+jsonrpc_error_t twice (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	(void)argv;
+	(void)print_result;
+	jsonrpc_writer_int64((jsonrpc_writer_t *)ctx, 1);
+	jsonrpc_writer_int64((jsonrpc_writer_t *)ctx, 2);
 	return JSONRPC_ERROR_OK;
 }
 
-jsonrpc_error_t foobar (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+
+/**
+ * examples of the JSON-RPC 2.0 specification (http://www.jsonrpc.org/specification#examples)
+ */
+static const struct {
+	const char *title;
+	const char *request;
+	const char *response;	///< NULL: no response
+} spec[] = {
+	{ "rpc call with positional parameters"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42, 23], \"id\": 1}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":19,\"id\":1}"
+	},
+	{ "rpc call with positional parameters"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [23, 42], \"id\": 2}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":-19,\"id\":2}"
+	},
+	{ "rpc call with named parameters"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": {\"subtrahend\": 23, \"minuend\": 42}, \"id\": 3}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":19,\"id\":3}"
+	},
+	{ "rpc call with named parameters"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": {\"minuend\": 42, \"subtrahend\": 23}, \"id\": 4}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":19,\"id\":4}"
+	},
+	{ "a Notification"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"update\", \"params\": [1,2,3,4,5]}"
+		, NULL
+	},
+	{ "a Notification"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\"}"
+		, NULL
+	},
+	{ "rpc call of non-existent method"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\", \"id\": \"1\"}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"Method not found\"},\"id\":\"1\"}"
+	},
+	{ "rpc call with invalid JSON"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar, \"params\": \"bar\", \"baz]"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "rpc call with invalid Request object"
+		, "{\"jsonrpc\": \"2.0\", \"method\": 1, \"params\": \"bar\"}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null}"
+	},
+	{ "rpc call Batch, invalid JSON"
+		, "["
+			"{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\"},"
+			"{\"jsonrpc\": \"2.0\", \"method\""
+		  "]"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "rpc call with an empty Array"
+		, "[]"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null}"
+	},
+	{ "rpc call with an invalid Batch (but not empty)"
+		, "[1]"
+		, "[{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null}]"
+	},
+	{ "rpc call with invalid Batch"
+		, "[1,2,3]"
+		, "["
+			"{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null},"
+			"{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null},"
+			"{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null}"
+		  "]"
+	},
+	{ "rpc call Batch"
+		, "["
+			"{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\"},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_hello\", \"params\": [7]},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42,23], \"id\": \"2\"},"
+			"{\"foo\": \"boo\"},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"foo.get\", \"params\": {\"name\": \"myself\"}, \"id\": \"5\"},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"get_data\", \"id\": \"9\"} "
+		  "]"
+		, "["
+			"{\"jsonrpc\":\"2.0\",\"result\":7,\"id\":\"1\"},"
+			"{\"jsonrpc\":\"2.0\",\"result\":19,\"id\":\"2\"},"
+			"{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"},\"id\":null},"
+			"{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"Method not found\"},\"id\":\"5\"},"
+			"{\"jsonrpc\":\"2.0\",\"result\":[\"hello\",5],\"id\":\"9\"}"
+		  "]"
+	},
+	{ "rpc call Batch (all notifications)"
+		, "["
+			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_sum\", \"params\": [1,2,4]},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_hello\", \"params\": [7]}"
+		  "]"
+		, NULL
+	},
+	{ "a \"batch\" member does not make a request a batch"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\", \"batch\": [1]}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":7,\"id\":\"1\"}"
+	},
+	{ "string escapes are unescaped, and escaped again where JSON needs it"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"a\\tb\\u00e9\\ud83d\\ude00\"], \"id\": 10}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":\"a\\tb\xc3\xa9\xf0\x9f\x98\x80\",\"id\":10}"
+	},
+	{ "long strings and string ids are escaped"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"0123456789abcdefghijklmnopqrstu\\\"0123456789abcdefghijklmnopqrstuvwxyz\\\\\\u0000\"], \"id\": \"a\\\"b\"}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":\"0123456789abcdefghijklmnopqrstu\\\"0123456789abcdefghijklmnopqrstuvwxyz\\\\\\u0000\",\"id\":\"a\\\"b\"}"
+	},
+	{ "integer params and ids round-trip exactly"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [9007199254740993, -2], \"id\": 9223372036854775807}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":9007199254740991,\"id\":9223372036854775807}"
+	},
+	{ "a fraction is not an integer"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"add64\", \"params\": [1.5, 2], \"id\": 11}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"Method not found\"},\"id\":11}"
+	},
+	{ "string length counts unescaped bytes, including \\u0000"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"length\", \"params\": [\"a\\u0000\\u00e9\"], \"id\": 12}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":4,\"id\":12}"
+	},
+	{ "malformed UTF-8 is a parse error"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"\xc0\xaf\"], \"id\": 13}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "UTF-8 encoded surrogates are a parse error"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"0123456789abcdefghijklmnopqrstuvwxyz\xed\xa0\x80\"], \"id\": 14}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "a truncated UTF-8 sequence is a parse error"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"\xe2\x82\"], \"id\": 15}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "malformed UTF-8 in a member name is a parse error"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"a\"], \"\xc0\xaf\": 0, \"id\": 21}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "doubles print with the shortest digits that read back exactly"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [0.3, 0.1], \"id\": 1e-7}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":0.19999999999999998,\"id\":1e-7}"
+	},
+	{ "result written with the writer, strings escaped"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"profile\", \"params\": [\"q\\\"\\\\\\n\\u0001\u00e9\"], \"id\": 16}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":{\"name\":\"q\\\"\\\\\\n\\u0001\u00e9\",\"id\":-9223372036854775808,\"score\":0.5,\"tags\":[\"a\",true,null,{},[1,2]]},\"id\":16}"
+	},
+	{ "misuse of the writer fails the call"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"unbalanced\", \"id\": 17}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32097,\"message\":\"Server: Internal error\"},\"id\":17}"
+	},
+	{ "a second result fails the call"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"twice\", \"id\": 17}"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32097,\"message\":\"Server: Internal error\"},\"id\":17}"
+	},
+	{ "trailing garbage is a parse error"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\"} x"
+		, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32700,\"message\":\"Parse error\"},\"id\":null}"
+	},
+	{ "methods build their results in scratch memory"
+		, "[{\"jsonrpc\": \"2.0\", \"method\": \"reverse\", \"params\": [\"stressed\"], \"id\": 18},"
+			"{\"jsonrpc\": \"2.0\", \"method\": \"reverse\", \"params\": [\"\"], \"id\": 19}]"
+		, "[{\"jsonrpc\":\"2.0\",\"result\":\"desserts\",\"id\":18},{\"jsonrpc\":\"2.0\",\"result\":\"\",\"id\":19}]"
+	},
+	{ "number literals of any length"
+		, "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [0.3000000000000000000000000000000000000000000000000000000000000000000000000, 0.1], \"id\": 20}"
+		, "{\"jsonrpc\":\"2.0\",\"result\":0.19999999999999998,\"id\":20}"
+	},
+};
+
+
+/**
+ * collects a streamed response
+ */
+typedef struct
 {
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+	char	buf[4096];
+	size_t	length;
+	int		last;	///< number of parts with more == JSONRPC_FALSE
+} stream_t;
 
+static jsonrpc_error_t collect (void *ctx, const char *data, size_t length, jsonrpc_bool_t more)
+{
+	stream_t *stream = (stream_t *)ctx;
+
+	if (stream->last || stream->length + length >= sizeof(stream->buf))
+		return JSONRPC_ERROR_SERVER_INTERNAL;
+	memcpy(stream->buf + stream->length, data, length);
+	stream->length += length;
+	stream->buf[stream->length] = '\0';
+	stream->last += !more;
 	return JSONRPC_ERROR_OK;
 }
 
+static char * grow (void *ctx, char *buf, size_t size)
+{
+	(void)ctx;
+	return (char *)realloc(buf, size);
+}
 
-jsonrpc_error_t test_param (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+/**
+ * the response written into a buffer of the caller: one growing, one too small to hold it
+ */
+static int execute_into (jsonrpc_server_t *server, const char *request, const char *expected, stream_t *stream)
 {
-	printf("%s(argc:%d)\n", __FUNCTION__, argc);
+	jsonrpc_buffer_t	out;
+	char	small[8];
+	char	*heap;
+	size_t	length;
+	int		ok;
 
-	printf("\t%c:%s\n", (char)argv->json.type, argv->json.u.string);
-	argv++;
-	printf("\t%c:%d\n", (char)argv->json.type, argv->json.u.boolean);
-	argv++;
-	printf("\t%c:0x%X\n", (char)argv->json.type, argv->json.u.object);
-	argv++;
-	printf("\t%c:0x%X\n", (char)argv->json.type, argv->json.u.array);
-	argv++;
-	printf("\t%c:%lf\n", (char)argv->json.type, argv->json.u.number);
-	argv++;
+	heap = out.buf = (char *)malloc(8);
+	out.size = 8;
+	out.grow = grow;
+	out.ctx  = NULL;
+	length = jsonrpc_server_execute_into(server, request, &out);
+	if (length)
+		heap = out.buf;
+	ok = expected ? length == strlen(expected) && strcmp(out.buf, expected) == 0 : length == 0;
+	snprintf(stream->buf, sizeof(stream->buf), "%s", length ? out.buf : "");
+	free(heap);
+	if (!ok)
+		return 0;
 
-	return JSONRPC_ERROR_OK;
+	out.buf  = small;
+	out.size = sizeof(small);
+	out.grow = NULL;
+	length = jsonrpc_server_execute_into(server, request, &out);
+	snprintf(stream->buf, sizeof(stream->buf), "%s", length ? out.buf : "");
+	return expected ? length == strlen(expected) && strcmp(out.buf, expected) == 0 : length == 0;
 }
 
+jsonrpc_error_t reverse (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	size_t	i, n = argv[0].json.length;
+	char	*buf = (char *)jsonrpc_writer_alloc((jsonrpc_writer_t *)ctx, n);
 
-int main (int argc, const char * argv[])
+	(void)argc;
+	(void)print_result;
+	if (buf == NULL)
+		return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
+	for (i = 0 ; i < n ; i++)
+		buf[i] = argv[0].json.u.string[n - 1 - i];
+	return jsonrpc_writer_string((jsonrpc_writer_t *)ctx, buf, n);
+}
+
+static void register_methods (jsonrpc_server_t *server)
+{
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, subtract, "subtract", "minuend:i, subtrahend:i");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, sum, "sum", "iii");
+	jsonrpc_server_register_method(server, JSONRPC_FALSE, update, "update", "iiiii");
+	jsonrpc_server_register_method(server, JSONRPC_FALSE, foobar, "foobar", NULL);
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, get_data, "get_data", NULL);
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, echo, "echo", "s");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, add64, "add64", "ll");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, length, "length", "s");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, profile, "profile", "s");
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, unbalanced, "unbalanced", NULL);
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, twice, "twice", NULL);
+	jsonrpc_server_register_method(server, JSONRPC_TRUE, reverse, "reverse", "s");
+}
+
+static int test_spec (const char *name, const jsonrpc_json_plugin_t *plugin, long threads, long split)
 {
 	jsonrpc_server_t *server;
-	jsonrpc_error_t   error;
-	const char       *req, *res;
+	const char       *res;
+	stream_t          stream;
+	const jsonrpc_iovec_t *iov;
+	size_t            i, n;
+	int               failed = 0;
+
+	server = jsonrpc_server_open(plugin, NULL);
+	if (server == NULL)
+	{
+		printf("[%s] jsonrpc_server_open failed\n", name);
+		return 1;
+	}
+	if (jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_THREADS, threads) != JSONRPC_ERROR_OK)
+	{
+		printf("[%s] %ld batch threads not supported\n", name, threads);
+		jsonrpc_server_close(server);
+		return threads ? 0 : 1;
+	}
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_SPLIT, split);
+	register_methods(server);
+
+	for (i = 0 ; i < sizeof(spec) / sizeof(spec[0]) ; i++)
+	{
+		res = jsonrpc_server_execute(server, spec[i].request);
+		if ((res == NULL && spec[i].response == NULL)
+			|| (res && spec[i].response && strcmp(res, spec[i].response) == 0))
+		{
+			// the streamed response must be the same, ended by exactly one last part
+			memset(&stream, 0, sizeof(stream));
+			if (jsonrpc_server_execute_stream(server, spec[i].request, collect, &stream) != JSONRPC_ERROR_OK
+				|| (spec[i].response ? stream.last != 1 || strcmp(stream.buf, spec[i].response) != 0 : stream.length != 0))
+				res = stream.buf;
+			else
+			{
+				// and so must the pieces of the response in place
+				memset(&stream, 0, sizeof(stream));
+				for (n = jsonrpc_server_execute_iov(server, spec[i].request, &iov) ; n > 0 ; n--, iov++)
+					collect(&stream, iov->base, iov->length, n > 1);
+				if (spec[i].response ? stream.last != 1 || strcmp(stream.buf, spec[i].response) != 0 : stream.length != 0)
+					res = stream.buf;
+				// and so must the response written into a buffer of the caller
+				else if (execute_into(server, spec[i].request, spec[i].response, &stream))
+					continue;
+				else
+					res = stream.buf;
+			}
+		}
+
+		printf("[%s] FAIL: %s\n--> %s\n<-- %s\nexpected: %s\n\n"
+			, name, spec[i].title, spec[i].request, res ? res : "(null)"
+			, spec[i].response ? spec[i].response : "(null)"
+		);
+		failed++;
+	}
+	printf("[%s, %ld batch threads%s] %d/%d passed\n", name, threads, split ? ", split" : "", (int)(i - failed), (int)i);
+
+	jsonrpc_server_close(server);
+	return failed;
+}
+
+/**
+ * allocator that counts its live blocks
+ */
+typedef struct
+{
+	long	live;
+	long	calls;
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_t	lock;	///< batch workers allocate too
+#endif
+} counter_t;
+
+static void count (counter_t *counter, long live)
+{
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_lock(&counter->lock);
+#endif
+	counter->live += live;
+	counter->calls++;
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_unlock(&counter->lock);
+#endif
+}
 
-	server = jsonrpc_server_open(jsonrpc_plugin_yajl());
+static void * counted_malloc (size_t n, void *userdata)
+{
+	count((counter_t *)userdata, 1);
+	return malloc(n);
+}
+
+static void * counted_realloc (void *mem, size_t n, void *userdata)
+{
+	count((counter_t *)userdata, mem ? 0 : 1);
+	return realloc(mem, n);
+}
+
+static void counted_free (void *mem, void *userdata)
+{
+	count((counter_t *)userdata, mem ? -1 : 0);
+	free(mem);
+}
+
+/**
+ * all the memory of a server (batch workers included) comes from its own allocator,
+ * not the one of the calling thread, and all of it is given back
+ */
+static int test_allocator (const char *name, const jsonrpc_json_plugin_t *plugin)
+{
+	counter_t           own, caller;
+	jsonrpc_allocator_t own_alloc    = { counted_malloc, counted_realloc, counted_free, &own };
+	jsonrpc_allocator_t caller_alloc = { counted_malloc, counted_realloc, counted_free, &caller };
+	jsonrpc_server_t   *server;
+	size_t              i;
+	int                 failed = 0;
 
-	error  = jsonrpc_server_register_method(server, JSONRPC_TRUE, subtract, "subtract", "minuend:i, subtrahend:i");
-	error  = jsonrpc_server_register_method(server, JSONRPC_TRUE, sum, "sum", "iii");
-	error  = jsonrpc_server_register_method(server, JSONRPC_FALSE, update, "update", "iiiii");
-	error  = jsonrpc_server_register_method(server, JSONRPC_FALSE, foobar, "foobar", NULL);
-	error  = jsonrpc_server_register_method(server, JSONRPC_TRUE, get_data, "get_data", NULL);
-	error  = jsonrpc_server_register_method(server, JSONRPC_FALSE, test_param, "test.param", "sboai");
+	memset(&own, 0, sizeof(own));
+	memset(&caller, 0, sizeof(caller));
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_init(&own.lock, NULL);
+	pthread_mutex_init(&caller.lock, NULL);
+#endif
+	jsonrpc_set_thread_allocator(&caller_alloc);
 
-	printf("[rpc call with positional parameters]\n");
+	server = jsonrpc_server_open_ex(&own_alloc, plugin, NULL);
+	if (server)
 	{
-		req = "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42, 23], \"id\": 1}";
-		res = jsonrpc_server_execute(server, req);
-		printf("--> %s\n<-- %s\n\n", req, res);
+		register_methods(server);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_THREADS, 2);
+		for (i = 0 ; i < sizeof(spec) / sizeof(spec[0]) ; i++)
+			jsonrpc_server_execute(server, spec[i].request);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_SPLIT, 1);
+		for (i = 0 ; i < sizeof(spec) / sizeof(spec[0]) ; i++)
+			jsonrpc_server_execute(server, spec[i].request);
+		jsonrpc_server_close(server);
+	}
+	jsonrpc_set_thread_allocator(NULL);
 
-		req = "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [23, 42], \"id\": 1}";
-		res = jsonrpc_server_execute(server, req);
-		printf("--> %s\n<-- %s\n\n", req, res);
+	if (server == NULL || own.calls == 0 || own.live != 0 || caller.calls != 0)
+	{
+		printf("[%s] FAIL: allocator: %ld calls, %ld blocks left, %ld calls to the caller's\n\n"
+			, name, own.calls, own.live, caller.calls);
+		failed++;
 	}
+	printf("[%s] allocator %d/1 passed\n", name, 1 - failed);
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_destroy(&own.lock);
+	pthread_mutex_destroy(&caller.lock);
+#endif
+	return failed;
+}
 
-	printf("[rpc call with named parameters:]\n");
+#define	BIG_BATCH		1000
+
+/**
+ * a batch response much bigger than a chunk of the response streams, twice
+ */
+static int test_big_batch (const char *name, const jsonrpc_json_plugin_t *plugin, long hugepage)
+{
+	jsonrpc_server_t *server;
+	const char       *res;
+	char             *request, *expected;
+	size_t            i, req, exp;
+	int               round, failed = 0;
+	jsonrpc_arena_t  *arena;
+	jsonrpc_memory_stats_t stats;
+
+	server   = jsonrpc_server_open(plugin, NULL);
+	request  = (char *)malloc(BIG_BATCH * 128);
+	expected = (char *)malloc(BIG_BATCH * 128);
+	if (server == NULL || request == NULL || expected == NULL)
 	{
-		req = "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": {\"subtrahend\": 23, \"minuend\": 42}, \"id\": 3}";
-		res = jsonrpc_server_execute(server, req);
-		printf("--> %s\n<-- %s\n\n", req, res);
+		printf("[%s] big batch: out of memory\n", name);
+		return 1;
+	}
+	register_methods(server);
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_ARENA_HUGEPAGE, hugepage);
 
-		req = "{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": {\"minuend\": 42, \"subtrahend\": 23}, \"id\": 4}";
-		res = jsonrpc_server_execute(server, req);
-		printf("--> %s\n<-- %s\n\n", req, res);
+	for (i = 0, req = 0, exp = 0 ; i < BIG_BATCH ; i++)
+	{
+		req += sprintf(request + req, "%s{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"payload %04d \\\"quoted\\\"\"], \"id\": %d}"
+			, i ? "," : "[", (int)i, (int)i);
+		exp += sprintf(expected + exp, "%s{\"jsonrpc\":\"2.0\",\"result\":\"payload %04d \\\"quoted\\\"\",\"id\":%d}"
+			, i ? "," : "[", (int)i, (int)i);
 	}
+	strcpy(request + req, "]");
+	strcpy(expected + exp, "]");
 
-	printf("[a Notification:]\n");
-	req = "{\"jsonrpc\": \"2.0\", \"method\": \"update\", \"params\": [1,2,3,4,5]}";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	for (round = 0 ; round < 2 ; round++)
+	{
+		res = jsonrpc_server_execute(server, request);
+		if (res == NULL || strcmp(res, expected) != 0)
+		{
+			printf("[%s] FAIL: big batch (round %d)\n<-- %.200s\n\n", name, round, res ? res : "(null)");
+			failed++;
+		}
+	}
+	// the chunks of the arenas, mapped or not, are memory of the server
+	jsonrpc_server_get_memory_stats(server, &stats);
+	if (stats.classes[JSONRPC_MEMORY_ARENA].live == 0 || stats.total.live < stats.classes[JSONRPC_MEMORY_ARENA].live)
+	{
+		printf("[%s] FAIL: big batch, %lu bytes of arenas out of %lu\n", name
+			, (unsigned long)stats.classes[JSONRPC_MEMORY_ARENA].live, (unsigned long)stats.total.live);
+		failed++;
+	}
+	printf("[%s%s] big batch %d/3 passed\n", name, hugepage ? ", huge pages" : "", 3 - failed);
 
-	req = "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\"}";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	// sizes which would overflow once aligned are refused, not wrapped around
+	arena = jsonrpc_arena_open(1024, hugepage ? JSONRPC_ARENA_HUGEPAGE : 0);
+	if (arena == NULL || jsonrpc_arena_alloc(arena, SIZE_MAX) != NULL || jsonrpc_arena_alloc(arena, SIZE_MAX - 16) != NULL
+		|| jsonrpc_arena_alloc(arena, 64) == NULL || jsonrpc_arena_open(SIZE_MAX, 0) != NULL)
+	{
+		printf("[%s] FAIL: arena overflow\n", name);
+		failed++;
+	}
+	if (arena)
+		jsonrpc_arena_close(arena);
 
-	printf("[rpc call of non-existent method:]\n");
-	req = "{\"jsonrpc\": \"2.0\", \"method\": \"foobar\", \"id\": \"1\"}";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	free(request);
+	free(expected);
+	jsonrpc_server_close(server);
+	return failed;
+}
 
-	printf("[rpc call with invalid JSON:]\n");
-	req = "{\"jsonrpc\": \"2.0\", \"method\": \"foobar, \"params\": \"bar\", \"baz]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+#define	STEADY_ROUNDS		4000
+#define	STEADY_BATCH		50
 
-	printf("[rpc call with invalid Request object:]\n");
-	req = "{\"jsonrpc\": \"2.0\", \"method\": 1, \"params\": \"bar\"}";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+static void count_alloc (size_t size, void *userdata)
+{
+	(void)size;
+	count((counter_t *)userdata, 0);
+}
 
-	printf("[rpc call Batch, invalid JSON:]\n");
-	req = "["
-			  "{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\"},"
-			  "{\"jsonrpc\": \"2.0\", \"method\""
-		"]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+/**
+ * once preallocated, requests within the limits do not call the allocator,
+ * whichever way they are executed; a batch beyond them does
+ */
+static int test_steady_state (const char *name, const jsonrpc_json_plugin_t *plugin, long threads, long split)
+{
+	static char       into[16384];
+	jsonrpc_limits_t  limits = { 8192, sizeof(into), 16, 64 };
+	jsonrpc_server_t *server;
+	jsonrpc_buffer_t  out;
+	counter_t         hook;
+	stream_t          stream;
+	const jsonrpc_iovec_t *iov;
+	const char       *request, *res;
+	char             *batch;
+	size_t            i, n, length;
+	int               failed = 0;
 
-	printf("[rpc call with an empty Array:]\n");
-	req = "[]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	memset(&hook, 0, sizeof(hook));
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_init(&hook.lock, NULL);
+#endif
+	server = jsonrpc_server_open(plugin, NULL);
+	batch  = (char *)malloc(BIG_BATCH * 128);
+	if (server == NULL || batch == NULL)
+	{
+		printf("[%s] steady state: out of memory\n", name);
+		return 1;
+	}
+	register_methods(server);
+	jsonrpc_server_set_alloc_hook(server, count_alloc, &hook);
+	if (jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_THREADS, threads) != JSONRPC_ERROR_OK
+		|| jsonrpc_server_preallocate(server, &limits) != JSONRPC_ERROR_OK)
+	{
+		printf("[%s] FAIL: preallocate\n\n", name);
+		failed++;
+	}
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_SPLIT, split);
 
-	printf("[rpc call with an invalid Batch (but not empty):]\n");
-	req = "[1]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	for (i = 0, length = 0 ; i < STEADY_BATCH ; i++)
+	{
+		length += sprintf(batch + length, "%s{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"payload %04d\"], \"id\": %d}"
+			, i ? "," : "[", (int)i, (int)i);
+	}
+	strcpy(batch + length, "]");
 
-	printf("[rpc call with invalid Batch:]\n");
-	req = "[1,2,3]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	for (i = 0 ; i < STEADY_ROUNDS && !failed ; i++)
+	{
+		n = i % (sizeof(spec) / sizeof(spec[0]) + 1);
+		request = (n < sizeof(spec) / sizeof(spec[0])) ? spec[n].request : batch;
 
-	printf("[rpc call Batch:]\n");
-	req =  "["
-			"{\"jsonrpc\": \"2.0\", \"method\": \"sum\", \"params\": [1,2,4], \"id\": \"1\"},"
-			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_hello\", \"params\": [7]},"
-			"{\"jsonrpc\": \"2.0\", \"method\": \"subtract\", \"params\": [42,23], \"id\": \"2\"},"
-			"{\"foo\": \"boo\"},"
-			"{\"jsonrpc\": \"2.0\", \"method\": \"foo.get\", \"params\": {\"name\": \"myself\"}, \"id\": \"5\"},"
-			"{\"jsonrpc\": \"2.0\", \"method\": \"get_data\", \"id\": \"9\"} "
-    	"]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+		switch (i % 4)
+		{
+		case 0:
+			res = jsonrpc_server_execute(server, request);
+			if (n < sizeof(spec) / sizeof(spec[0])
+				&& !(res == NULL ? spec[n].response == NULL : spec[n].response && strcmp(res, spec[n].response) == 0))
+			{
+				printf("[%s] FAIL: steady state\n--> %s\n<-- %s\n\n", name, request, res ? res : "(null)");
+				failed++;
+			}
+			break;
+		case 1:
+			memset(&stream, 0, sizeof(stream));
+			jsonrpc_server_execute_stream(server, request, collect, &stream);
+			break;
+		case 2:
+			jsonrpc_server_execute_iov(server, request, &iov);
+			break;
+		default:
+			out.buf  = into;
+			out.size = sizeof(into);
+			out.grow = NULL;
+			out.ctx  = NULL;
+			jsonrpc_server_execute_into(server, request, &out);
+			break;
+		}
+	}
+	if (hook.calls != 0)
+	{
+		printf("[%s] FAIL: %ld allocator calls in steady state\n\n", name, hook.calls);
+		failed++;
+	}
 
-	printf("[rpc call Batch (all notifications):]\n");
-	req = "["
-			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_sum\", \"params\": [1,2,4]},"
-			"{\"jsonrpc\": \"2.0\", \"method\": \"notify_hello\", \"params\": [7]}"
-    	"]";
-	res = jsonrpc_server_execute(server, req);
-	printf("--> %s\n<-- %s\n\n", req, res);
+	// a batch of more calls than the limit is served all the same, but it is noticed
+	for (i = 0, length = 0 ; i < BIG_BATCH ; i++)
+	{
+		length += sprintf(batch + length, "%s{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"payload %04d\"], \"id\": %d}"
+			, i ? "," : "[", (int)i, (int)i);
+	}
+	strcpy(batch + length, "]");
+	res = jsonrpc_server_execute(server, batch);
+	if (res == NULL || hook.calls == 0)
+	{
+		printf("[%s] FAIL: a batch beyond the limits made %ld allocator calls\n\n", name, hook.calls);
+		failed++;
+	}
+	printf("[%s, %ld batch threads%s] steady state %d/1 passed\n", name, threads, split ? ", split" : "", failed ? 0 : 1);
+
+	free(batch);
+	jsonrpc_server_close(server);
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_destroy(&hook.lock);
+#endif
+	return failed ? 1 : 0;
+}
+
+#define	BIG_STRING		(2 * 1024 * 1024)
+#define	TRIM_THRESHOLD	(64 * 1024)
+#define	LONG_ID			(32 * 1024)
+
+/**
+ * the buffers grown by a big response are given back after it, and
+ * a server over its memory limit turns requests down
+ */
+static int test_memory (const char *name, const jsonrpc_json_plugin_t *plugin, long threads)
+{
+	static const char oom[] = "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32098,\"message\":\"Server: Out of memory\"},\"id\":null}";
+	jsonrpc_server_t *server;
+	jsonrpc_memory_stats_t stats;
+	const char       *res;
+	char             *request, *suffix;
+	size_t            length, slack;
+	int               failed = 0;
+
+	server  = jsonrpc_server_open(plugin, NULL);
+	request = (char *)malloc(BIG_STRING + 128);
+	suffix  = (char *)malloc(LONG_ID + 16);
+	if (server == NULL || request == NULL || suffix == NULL)
+	{
+		printf("[%s] memory: out of memory\n", name);
+		return 1;
+	}
+	register_methods(server);
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_THREADS, threads);
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_TRIM_THRESHOLD, TRIM_THRESHOLD);
+
+	length = sprintf(request, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"");
+	memset(request + length, 'x', BIG_STRING);
+	strcpy(request + length + BIG_STRING, "\"], \"id\": 1}");
+
+	res = jsonrpc_server_execute(server, request);
+	if (res == NULL || strlen(res) < BIG_STRING)
+	{
+		printf("[%s] FAIL: memory: big response\n<-- %.200s\n\n", name, res ? res : "(null)");
+		failed++;
+	}
+	res = jsonrpc_server_execute(server, spec[0].request);	// trims what the big one left
+	jsonrpc_server_get_memory_stats(server, &stats);
+	if (res == NULL || strcmp(res, spec[0].response) != 0
+		|| stats.total.peak < 2 * BIG_STRING || stats.total.live > BIG_STRING / 2
+		|| stats.classes[JSONRPC_MEMORY_STREAMS].peak < BIG_STRING || stats.classes[JSONRPC_MEMORY_STREAMS].live > BIG_STRING / 2
+		|| stats.classes[JSONRPC_MEMORY_TEXT].peak < BIG_STRING || stats.classes[JSONRPC_MEMORY_TEXT].live > TRIM_THRESHOLD
+		|| stats.classes[JSONRPC_MEMORY_PARAMS].live == 0 || stats.classes[JSONRPC_MEMORY_ARENA].live == 0)
+	{
+		printf("[%s] FAIL: memory: %lu bytes live (%lu at peak), %lu in streams (%lu), %lu in text (%lu)\n\n", name
+			, (unsigned long)stats.total.live, (unsigned long)stats.total.peak
+			, (unsigned long)stats.classes[JSONRPC_MEMORY_STREAMS].live, (unsigned long)stats.classes[JSONRPC_MEMORY_STREAMS].peak
+			, (unsigned long)stats.classes[JSONRPC_MEMORY_TEXT].live, (unsigned long)stats.classes[JSONRPC_MEMORY_TEXT].peak);
+		failed++;
+	}
+
+	// within a limit well below the big request, it is turned down and the small ones still go through
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, (long)(stats.total.live + BIG_STRING / 4));
+	res = jsonrpc_server_execute(server, request);
+	if (res == NULL || strcmp(res, oom) != 0)
+	{
+		printf("[%s] FAIL: memory limit\n<-- %.200s\n\n", name, res ? res : "(null)");
+		failed++;
+	}
+	res = jsonrpc_server_execute(server, spec[0].request);
+	jsonrpc_server_get_memory_stats(server, &stats);
+	if (res == NULL || strcmp(res, spec[0].response) != 0 || stats.refused == 0 || stats.total.live > stats.total.peak)
+	{
+		printf("[%s] FAIL: memory limit: %lu allocations refused\n<-- %s\n\n", name, (unsigned long)stats.refused, res ? res : "(null)");
+		failed++;
+	}
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, 0);
+	res = jsonrpc_server_execute(server, request);
+	if (res == NULL || strlen(res) < BIG_STRING)
+	{
+		printf("[%s] FAIL: memory limit lifted\n<-- %.200s\n\n", name, res ? res : "(null)");
+		failed++;
+	}
+
+	// a long string id under a tight limit: the response is whole, or the static "Out of memory" one
+	length = sprintf(request, "{\"jsonrpc\": \"2.0\", \"method\": \"echo\", \"params\": [\"");
+	memset(request + length, 'x', BIG_STRING / 4);
+	length += BIG_STRING / 4;
+	length += sprintf(request + length, "\"], \"id\": \"");
+	memset(request + length, 'i', LONG_ID);
+	strcpy(request + length + LONG_ID, "\"}");
+	strcpy(suffix, "\"id\":\"");
+	memset(suffix + 6, 'i', LONG_ID);
+	strcpy(suffix + 6 + LONG_ID, "\"}");
+
+	// on a new server, warm up on a missing method: the text and arena buffers grow, the response streams do not
+	jsonrpc_server_close(server);
+	server = jsonrpc_server_open(plugin, NULL);
+	register_methods(server);
+	jsonrpc_server_set_option(server, JSONRPC_OPTION_BATCH_THREADS, threads);
+	memcpy(strstr(request, "echo"), "ech0", 4);
+	jsonrpc_server_execute(server, request);
+	memcpy(strstr(request, "ech0"), "echo", 4);
+	for (slack = 0 ; slack <= BIG_STRING / 2 ; slack = slack ? slack * 4 : 256)
+	{
+		jsonrpc_server_get_memory_stats(server, &stats);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, (long)(stats.total.live + slack));
+		res = jsonrpc_server_execute(server, request);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, 0);
+		if (res == NULL || (strcmp(res, oom) != 0
+			&& (strlen(res) < strlen(suffix) || strcmp(res + strlen(res) - strlen(suffix), suffix) != 0)))
+		{
+			printf("[%s] FAIL: memory limit, long id, %lu bytes of slack\n<-- %.200s\n\n", name, (unsigned long)slack, res ? res : "(null)");
+			failed++;
+		}
+	}
+	printf("[%s, %ld batch threads] memory %d/1 passed\n", name, threads, failed ? 0 : 1);
 
+	free(suffix);
+	free(request);
 	jsonrpc_server_close(server);
-	return 0;
+	return failed ? 1 : 0;
+}
+
+static struct {
+	char	*text;		///< copy in scratch memory
+	size_t	length;
+	int		writes;		///< writer calls that did not fail
+} s_note;
+
+jsonrpc_error_t note (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
+{
+	(void)argc;
+	s_note.length = argv[0].json.length;
+	s_note.text   = (char *)jsonrpc_writer_alloc((jsonrpc_writer_t *)ctx, s_note.length + 1);
+	if (s_note.text == NULL || print_result != NULL)
+		return JSONRPC_ERROR_SERVER_INTERNAL;
+	memcpy(s_note.text, argv[0].json.u.string, s_note.length + 1);
+	s_note.writes = (jsonrpc_writer_string((jsonrpc_writer_t *)ctx, "dropped", 7) == JSONRPC_ERROR_OK);
+	return JSONRPC_ERROR_OK;
+}
+
+/**
+ * a notification has scratch memory too, and it is the same memory again for the next request
+ */
+static int test_scratch (const char *name, const jsonrpc_json_plugin_t *plugin)
+{
+	static const char *request = "{\"jsonrpc\": \"2.0\", \"method\": \"note\", \"params\": [\"hello\"]}";
+	jsonrpc_server_t *server;
+	char             *first = NULL;
+	int               round, failed = 0;
+
+	server = jsonrpc_server_open(plugin, NULL);
+	if (server == NULL)
+	{
+		printf("[%s] jsonrpc_server_open failed\n", name);
+		return 1;
+	}
+	jsonrpc_server_register_method(server, JSONRPC_FALSE, note, "note", "s");
+
+	for (round = 0 ; round < 3 ; round++)
+	{
+		memset(&s_note, 0, sizeof(s_note));
+		if (jsonrpc_server_execute(server, request) != NULL
+			|| s_note.text == NULL || strcmp(s_note.text, "hello") != 0 || !s_note.writes
+			|| (first && s_note.text != first))
+		{
+			printf("[%s] FAIL: scratch memory of a notification (round %d)\n\n", name, round);
+			failed++;
+			break;
+		}
+		first = s_note.text;
+	}
+	printf("[%s] scratch memory %d/1 passed\n", name, failed ? 0 : 1);
+
+	jsonrpc_server_close(server);
+	return failed;
+}
+
+/**
+ * registrations turned down by a memory limit leave the methods as they were
+ */
+static int test_register_limit (const char *name, const jsonrpc_json_plugin_t *plugin)
+{
+	jsonrpc_server_t *server;
+	jsonrpc_memory_stats_t stats;
+	const char       *res;
+	char              method[32], request[128];
+	int               i, refused = 0, failed = 0;
+
+	server = jsonrpc_server_open(plugin, NULL);
+	if (server == NULL)
+	{
+		printf("[%s] jsonrpc_server_open failed\n", name);
+		return 1;
+	}
+	register_methods(server);
+
+	for (i = 0 ; i < 256 && !failed ; i++)
+	{
+		// a little more room every time, so that each allocation of a registration fails in turn
+		sprintf(method, "capped%d", i);
+		jsonrpc_server_get_memory_stats(server, &stats);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, (long)stats.total.live + i * 8);
+		refused += (jsonrpc_server_register_method(server, JSONRPC_TRUE, echo, method, "s") != JSONRPC_ERROR_OK);
+		jsonrpc_server_set_option(server, JSONRPC_OPTION_MEMORY_LIMIT, 0);
+
+		sprintf(request, "{\"jsonrpc\": \"2.0\", \"method\": \"%s\", \"params\": [\"x\"], \"id\": 1}", method);
+		res = jsonrpc_server_execute(server, request);
+		if (res == NULL
+			|| (strcmp(res, "{\"jsonrpc\":\"2.0\",\"result\":\"x\",\"id\":1}") != 0
+				&& strcmp(res, "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"Method not found\"},\"id\":1}") != 0))
+		{
+			printf("[%s] FAIL: registration under a memory limit\n--> %s\n<-- %s\n\n", name, request, res ? res : "(null)");
+			failed++;
+		}
+	}
+	res = jsonrpc_server_execute(server, spec[0].request);
+	if (refused == 0 || res == NULL || strcmp(res, spec[0].response) != 0)
+	{
+		printf("[%s] FAIL: registration under a memory limit: %d refused\n<-- %s\n\n", name, refused, res ? res : "(null)");
+		failed++;
+	}
+	printf("[%s] registration under a memory limit %d/1 passed\n", name, failed ? 0 : 1);
+
+	jsonrpc_server_close(server);
+	return failed ? 1 : 0;
+}
+
+#ifdef JSONRPC_HAVE_PTHREAD
+#define	CONTEXT_THREADS		4
+#define	CONTEXT_ROUNDS		200
+
+/**
+ * runs the spec over and over in its own execution context
+ */
+static void * run_context (void *arg)
+{
+	jsonrpc_exec_ctx_t *ctx;
+	const char         *res;
+	size_t              i, round;
+	long                failed = 0;
+
+	ctx = jsonrpc_exec_ctx_open((jsonrpc_server_t *)arg);
+	if (ctx == NULL)
+		return (void *)1;
+
+	for (round = 0 ; round < CONTEXT_ROUNDS ; round++)
+	{
+		for (i = 0 ; i < sizeof(spec) / sizeof(spec[0]) ; i++)
+		{
+			res = jsonrpc_exec_ctx_execute(ctx, spec[i].request);
+			if ((res == NULL && spec[i].response == NULL)
+				|| (res && spec[i].response && strcmp(res, spec[i].response) == 0))
+				continue;
+			failed++;
+		}
+	}
+	jsonrpc_exec_ctx_close(ctx);
+	return (void *)failed;
+}
+
+static int test_contexts (const char *name, const jsonrpc_json_plugin_t *plugin)
+{
+	jsonrpc_server_t *server;
+	pthread_t         threads[CONTEXT_THREADS];
+	void             *ret;
+	int               i, n, failed = 0;
+
+	server = jsonrpc_server_open(plugin, NULL);
+	if (server == NULL)
+	{
+		printf("[%s] jsonrpc_server_open failed\n", name);
+		return 1;
+	}
+	register_methods(server);
+
+	for (n = 0 ; n < CONTEXT_THREADS ; n++)
+	{
+		if (pthread_create(threads + n, NULL, run_context, server) != 0)
+			break;
+	}
+	for (i = 0 ; i < n ; i++)
+	{
+		pthread_join(threads[i], &ret);
+		failed += (ret != NULL);
+	}
+	printf("[%s, %d execution contexts] %d/%d passed\n", name, CONTEXT_THREADS, n - failed, CONTEXT_THREADS);
+
+	jsonrpc_server_close(server);
+	return failed + (CONTEXT_THREADS - n);
+}
+#endif
+
+int main (int argc, const char * argv[])
+{
+	int  failed = 0;
+	long threads, split;
+
+	(void)argc;
+	(void)argv;
+	for (split = 0 ; split <= 1 ; split++)
+	for (threads = 0 ; threads <= 4 ; threads += 4)
+	{
+		failed += test_spec("insitu", jsonrpc_plugin_insitu(), threads, split);
+		failed += test_spec("simd", jsonrpc_plugin_simd(), threads, split);
+#ifdef JSONRPC_TEST_YAJL
+		failed += test_spec("yajl", jsonrpc_plugin_yajl(), threads, split);
+		failed += test_spec("yajl_sax", jsonrpc_plugin_yajl_sax(), threads, split);
+#endif
+	}
+	failed += test_allocator("insitu", jsonrpc_plugin_insitu());
+	failed += test_allocator("simd", jsonrpc_plugin_simd());
+#ifdef JSONRPC_TEST_YAJL
+	failed += test_allocator("yajl_sax", jsonrpc_plugin_yajl_sax());
+#endif
+	failed += test_big_batch("insitu", jsonrpc_plugin_insitu(), 0);
+	failed += test_big_batch("insitu", jsonrpc_plugin_insitu(), 1);
+	failed += test_big_batch("simd", jsonrpc_plugin_simd(), 0);
+	for (split = 0 ; split <= 1 ; split++)
+	for (threads = 0 ; threads <= 2 ; threads += 2)
+	{
+		failed += test_steady_state("insitu", jsonrpc_plugin_insitu(), threads, split);
+		failed += test_steady_state("simd", jsonrpc_plugin_simd(), threads, split);
+	}
+	failed += test_scratch("insitu", jsonrpc_plugin_insitu());
+	failed += test_scratch("simd", jsonrpc_plugin_simd());
+	failed += test_register_limit("insitu", jsonrpc_plugin_insitu());
+	for (threads = 0 ; threads <= 2 ; threads += 2)
+	{
+		failed += test_memory("insitu", jsonrpc_plugin_insitu(), threads);
+		failed += test_memory("simd", jsonrpc_plugin_simd(), threads);
+	}
+#ifdef JSONRPC_HAVE_PTHREAD
+	failed += test_contexts("insitu", jsonrpc_plugin_insitu());
+	failed += test_contexts("simd", jsonrpc_plugin_simd());
+#ifdef JSONRPC_TEST_YAJL
+	failed += test_contexts("yajl", jsonrpc_plugin_yajl());
+	failed += test_contexts("yajl_sax", jsonrpc_plugin_yajl_sax());
+#endif
+#endif
+	return failed ? 1 : 0;
 }
 
@@ -6,7 +6,6 @@
  */
 
 #include <stdio.h>
-#include <math.h>
 #include <jsonrpc.h>
 
 
@@ -16,22 +15,17 @@
 
 jsonrpc_error_t subtract (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r, f;
+	double r;
 
 	printf("%s(argc:%d)\n", __FUNCTION__, argc);
 
 	r = argv[0].json.u.number - argv[1].json.u.number;
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
-	return JSONRPC_ERROR_OK;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, r);
 }
 
 jsonrpc_error_t sum (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r = 0.0, f;
+	double r = 0.0;
 
 	printf("%s(argc:%d)\n", __FUNCTION__, argc);
 
@@ -40,27 +34,17 @@ jsonrpc_error_t sum (int argc, const jsonrpc_param_t *argv, void (* print_result
 		r += argv[argc].json.u.number;
 	}
 
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
-	return JSONRPC_ERROR_OK;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, r);
 }
 
 jsonrpc_error_t multiply (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
 {
-	double r, f;
+	double r;
 
 	printf("%s(argc:%d)\n", __FUNCTION__, argc);
 
 	r = argv[0].json.u.number * argv[1].json.u.number;
-	f = fmod(r, 1.0);
-	if (f == 0.0)
-		print_result(ctx, "%.0lf", r);
-	else
-		print_result(ctx, "%lf", r);
-	return JSONRPC_ERROR_OK;
+	return jsonrpc_writer_number((jsonrpc_writer_t *)ctx, r);
 }
 
 jsonrpc_error_t get_data (int argc, const jsonrpc_param_t *argv, void (* print_result)(void *ctx, const char *fmt, ...), void *ctx)
@@ -15,6 +15,7 @@ typedef struct jsonrpc_ws_data
 	struct jsonrpc_ws_data	*next;
 	struct libwebsocket 	*wsi;
 	size_t		size;
+	size_t		alloc;		///< room for 'data' (reused for messages up to that size)
 	char		data[4];
 } jsonrpc_ws_data_t;
 
@@ -31,8 +32,17 @@ typedef struct
 	jsonrpc_queue_t			rx;
 	jsonrpc_queue_t 		tx;
 	jsonrpc_ws_data_t	*garbage;
+	jsonrpc_ws_data_t	*spare;		///< messages done with, for the next ones
+	size_t				spare_count;
+	size_t				spare_bytes;	///< room of the 'spare' messages
 } jsonrpc_websocket_t;
 
+#define	MIN_WEBSOCKET_DATA	256
+
+#define	MAX_WEBSOCKET_SPARE			16				///< most messages kept for reuse
+#define	MAX_WEBSOCKET_SPARE_BYTES	(1024 * 1024)	///< most room kept in them, all together
+#define	MAX_WEBSOCKET_SPARE_DATA	(64 * 1024)		///< bigger messages are freed, not kept
+
 #define	MAX_WEBSOCKET_TEMP	64
 // TODO: semaphore.. ??
 static jsonrpc_websocket_t *ws_temp[MAX_WEBSOCKET_TEMP];
@@ -66,23 +76,75 @@ static jsonrpc_websocket_t *	pop_websocket_from_temp (struct libwebsocket_contex
 }
 
 
-static jsonrpc_ws_data_t *	queue_push (jsonrpc_queue_t *queue, const char *text)
+/**
+ * the smallest spare message with room for 'len' bytes, or a new one (once warmed up, the queues do not allocate)
+ */
+static jsonrpc_ws_data_t *	queue_get_spare (jsonrpc_websocket_t *ws, size_t len)
+{
+	jsonrpc_ws_data_t	**prev, **best = NULL, *q;
+	size_t	alloc;
+
+	for (alloc = MIN_WEBSOCKET_DATA ; alloc < len ; alloc *= 2)
+		;
+	for (prev = &ws->spare ; (q = *prev) != NULL ; prev = &q->next)
+	{
+		if (q->alloc >= len && (best == NULL || q->alloc < (*best)->alloc))
+		{
+			best = prev;
+			if (q->alloc == alloc)	// none can be smaller
+				break;
+		}
+	}
+	if (best)
+	{
+		q = *best;
+		*best = q->next;
+		ws->spare_count--;
+		ws->spare_bytes -= q->alloc;
+	}
+	else
+	{
+		q = (jsonrpc_ws_data_t *)jsonrpc_malloc(sizeof(jsonrpc_ws_data_t) + alloc);
+		if (q == NULL)
+			return NULL;
+		q->alloc = alloc;
+	}
+	q->next = NULL;
+	return q;
+}
+
+/**
+ * keep a message for reuse, unless it is a big one or there are enough already
+ */
+static void	queue_put_spare (jsonrpc_websocket_t *ws, jsonrpc_ws_data_t *item)
+{
+	if (item->alloc > MAX_WEBSOCKET_SPARE_DATA || ws->spare_count >= MAX_WEBSOCKET_SPARE
+		|| ws->spare_bytes + item->alloc > MAX_WEBSOCKET_SPARE_BYTES)
+	{
+		jsonrpc_free(item);
+		return;
+	}
+	item->next = ws->spare;
+	ws->spare = item;
+	ws->spare_count++;
+	ws->spare_bytes += item->alloc;
+}
+
+static jsonrpc_ws_data_t *	queue_push (jsonrpc_websocket_t *ws, jsonrpc_queue_t *queue, const char *text, size_t len)
 {
 	jsonrpc_ws_data_t	*q;
-	size_t	len;
 	
-	if (text == NULL)
-		return NULL;
-	len = strlen(text);
-	if (len == 0)
+	if (text == NULL || len == 0)
 		return NULL;
 	
-	q = (jsonrpc_ws_data_t *)calloc(1, sizeof(jsonrpc_ws_data_t) + len);
+	q = queue_get_spare(ws, len);
 	if (q == NULL)
 		return NULL;
 	
 	q->size = len;
+	q->wsi  = NULL;
 	memcpy(q->data, text, len);
+	q->data[len] = '\0';
 	
 	if (queue->tail == NULL)
 		queue->head = queue->tail = q;
@@ -109,16 +171,15 @@ static jsonrpc_ws_data_t *	queue_pop (jsonrpc_queue_t *queue)
 	return q;
 }
 
-static void	queue_remove_all (jsonrpc_queue_t *queue)
+static void	queue_remove_all (jsonrpc_ws_data_t *item)
 {
-	jsonrpc_ws_data_t *freed, *item;
+	jsonrpc_ws_data_t *freed;
 
-	item = queue->head;
 	while (item)
 	{
 		freed = item;
 		item = item->next;
-		free(freed);
+		jsonrpc_free(freed);
 	}
 }
 
@@ -130,14 +191,14 @@ static void	queue_put_into_trash (jsonrpc_websocket_t *ws, jsonrpc_ws_data_t *it
 
 static void	queue_gc (jsonrpc_websocket_t *ws)
 {
-	jsonrpc_ws_data_t *freed, *garbage;
+	jsonrpc_ws_data_t *spare, *garbage;
 
 	garbage = ws->garbage;
 	while (garbage)
 	{
-		freed = garbage;
+		spare = garbage;
 		garbage = garbage->next;
-		free(freed);
+		queue_put_spare(ws, spare);
 	}
 	ws->garbage = NULL;
 }
@@ -207,7 +268,7 @@ static int websocket_listener (struct libwebsocket_context *context,
 			if (data)
 			{
 				n = libwebsocket_write(wsi, (unsigned char *)data->data, data->size, LWS_WRITE_TEXT);
-				free(data);
+				queue_put_spare(session, data);
 				
 				if (n < 0)
 				{
@@ -230,7 +291,7 @@ static int websocket_listener (struct libwebsocket_context *context,
 		case LWS_CALLBACK_RECEIVE:
 			//fprintf(stderr, "%s(LWS_CALLBACK_RECEIVE)\n", __FUNCTION__);
 			session = *(jsonrpc_websocket_t **)user;
-			data    = queue_push(&session->rx, in);
+			data    = queue_push(session, &session->rx, (const char *)in, len);	// 'in' is not NUL terminated
 			if (data)
 				data->wsi = wsi;
 			break;
@@ -266,14 +327,15 @@ static jsonrpc_handle_t	jsonrpc_websockets_server_open (va_list ap)
 
 	port   = va_arg(ap, int);
 	protocols[0].name = va_arg(ap, const char *);
-	ws_server = (jsonrpc_websocket_t *)calloc(1, sizeof(jsonrpc_websocket_t));
+	ws_server = (jsonrpc_websocket_t *)jsonrpc_malloc(sizeof(jsonrpc_websocket_t));
 	if (!ws_server)
 		return (jsonrpc_handle_t)NULL;
+	memset(ws_server, 0, sizeof(jsonrpc_websocket_t));
 
 	ws_ctx = libwebsocket_create_context(port, NULL, protocols, libwebsocket_internal_extensions, NULL, NULL, -1, -1, 0);
 	if (!ws_ctx)
 	{
-		free(ws_server);
+		jsonrpc_free(ws_server);
 		return (jsonrpc_handle_t)NULL;
 	}
 	ws_server->ws_ctx = ws_ctx;
@@ -291,9 +353,10 @@ static void				jsonrpc_websockets_server_close (jsonrpc_handle_t net)
 	{
 		libwebsocket_context_destroy(ws->ws_ctx);
 		queue_gc(ws);
-		queue_remove_all(&ws->rx);
-		queue_remove_all(&ws->tx);
-		free(ws);
+		queue_remove_all(ws->rx.head);
+		queue_remove_all(ws->tx.head);
+		queue_remove_all(ws->spare);
+		jsonrpc_free(ws);
 	}
 }
 
@@ -328,7 +391,8 @@ static jsonrpc_error_t	jsonrpc_websockets_server_send  (jsonrpc_handle_t net, co
 
 	ws = (jsonrpc_websocket_t *)net;
 
-	queue_push(&ws->tx, data);
+	if (data)
+		queue_push(ws, &ws->tx, data, strlen(data));
 
 	libwebsocket_callback_on_writable_all_protocol(
 		libwebsockets_get_protocol(desc)
@@ -354,7 +418,9 @@ const jsonrpc_net_plugin_t	* jsonrpc_plugin_websockets_server (void)
 		jsonrpc_websockets_server_close,
 		jsonrpc_websockets_server_recv,
 		jsonrpc_websockets_server_send,
-		jsonrpc_websockets_server_error
+		jsonrpc_websockets_server_error,
+		NULL,
+		NULL
 	};
 	return &plugin_websockets;
 }
@@ -31,6 +31,30 @@ static jsonrpc_handle_t	jsonrpc_yajl_get    (jsonrpc_handle_t json, const char *
 	return (jsonrpc_handle_t)yajl_tree_get((yajl_val)json, path, yajl_t_any);
 }
 
+static void				jsonrpc_yajl_get_members (jsonrpc_handle_t json, const char * const *keys, size_t n, jsonrpc_handle_t *values)
+{
+	yajl_val v = (yajl_val)json;
+	size_t	i, k;
+
+	for (k = 0 ; k < n ; k++)
+		values[k] = NULL;
+
+	if (v == NULL || v->type != yajl_t_object)
+		return;
+
+	for (i = 0 ; i < v->u.object.len ; i++)
+	{
+		for (k = 0 ; k < n ; k++)
+		{
+			if (values[k] == NULL && strcmp(v->u.object.keys[i], keys[k]) == 0)
+			{
+				values[k] = (jsonrpc_handle_t)v->u.object.values[i];
+				break;
+			}
+		}
+	}
+}
+
 static jsonrpc_handle_t	jsonrpc_yajl_get_at (jsonrpc_handle_t json, size_t index)
 {
 	yajl_val v = (yajl_val)json;
@@ -64,6 +88,7 @@ static jsonrpc_bool_t		jsonrpc_yajl_valueof (jsonrpc_handle_t json, jsonrpc_json
 {
 	yajl_val v = (yajl_val)json;
 
+	value->length = 0;
 	switch (v->type)
 	{
 	case yajl_t_string:
@@ -71,9 +96,18 @@ static jsonrpc_bool_t		jsonrpc_yajl_valueof (jsonrpc_handle_t json, jsonrpc_json
 		if (v->u.string == NULL)
 			return JSONRPC_FALSE;
 		value->u.string = v->u.string;
+		value->length   = strlen(v->u.string);
 		break;
 
 	case yajl_t_number:
+		// yajl marks '1.5' as a valid integer too, so look at the text
+		if ((v->u.number.flags & YAJL_NUMBER_INT_VALID) && strpbrk(v->u.number.r, ".eE") == NULL)
+		{
+			value->type = JSONRPC_TYPE_INTEGER;
+			value->u.integer = (int64_t)v->u.number.i;
+			break;
+		}
+
 		value->type = JSONRPC_TYPE_NUMBER;
 		if (v->u.number.flags & YAJL_NUMBER_DOUBLE_VALID)
 			value->u.number = v->u.number.d;
@@ -138,7 +172,10 @@ const jsonrpc_json_plugin_t	* jsonrpc_plugin_yajl (void)
 		jsonrpc_yajl_get_at,
 		jsonrpc_yajl_get_key_at,
 		jsonrpc_yajl_valueof,
-		jsonrpc_yajl_length
+		jsonrpc_yajl_length,
+		jsonrpc_yajl_get_members,
+		NULL,
+		JSONRPC_TRUE	// yajl validates the UTF-8 of strings
 	};
 	return &plugin_yajl;
 }
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include "jsonrpc_plugin_yajl_sax.h"
+
+#include <errno.h>
+#include <yajl/yajl_parse.h>
+
+
+typedef struct jsonrpc_sax_value	jsonrpc_sax_value_t;
+
+/**
+ * child slot: node index while parsing, node pointer afterwards
+ */
+typedef union
+{
+	size_t					index;
+	jsonrpc_sax_value_t		*value;
+} jsonrpc_sax_slot_t;
+
+struct jsonrpc_sax_value
+{
+	jsonrpc_type_t		type;
+	const char			*key;		///< member name (if parent is an object)
+	size_t				length;		///< number of children (array, object) or bytes (string)
+	union
+	{
+		double				number;
+		int64_t				integer;
+		jsonrpc_bool_t		boolean;
+		char				*string;
+		size_t				first;	///< first child in 'children' (while parsing)
+		jsonrpc_sax_slot_t	*items;	///< children (array, object)
+	} u;
+};
+
+typedef struct
+{
+	jsonrpc_sax_value_t	root;		///< must be the first member (handle of the document)
+
+	jsonrpc_sax_value_t	*nodes;
+	size_t				count;
+	size_t				alloc;
+
+	jsonrpc_sax_slot_t	*children;
+	size_t				children_count;
+	size_t				children_alloc;
+
+	jsonrpc_sax_slot_t	*pending;	///< children of open containers
+	size_t				pending_count;
+	size_t				pending_alloc;
+
+	struct {
+		size_t			node;
+		size_t			pending;	///< pending position of its first child
+	}					*stack;
+	size_t				depth;
+	size_t				stack_alloc;
+
+	const char			*key;
+	char				*pool;		///< unescaped strings (never larger than the input)
+	size_t				pool_length;
+} jsonrpc_sax_doc_t;
+
+
+static jsonrpc_bool_t	sax_reserve (void **array, size_t *alloc, size_t need, size_t size)
+{
+	void	*grown;
+	size_t	n;
+
+	if (need <= *alloc)
+		return JSONRPC_TRUE;
+
+	for (n = *alloc ? *alloc * 2 : 16 ; n < need ; n *= 2)
+		;
+	grown = jsonrpc_realloc(*array, n * size);
+	if (grown == NULL)
+		return JSONRPC_FALSE;
+	*array = grown;
+	*alloc = n;
+	return JSONRPC_TRUE;
+}
+
+static const char *		sax_strdup (jsonrpc_sax_doc_t *doc, const unsigned char *str, size_t len)
+{
+	char *dup = doc->pool + doc->pool_length;
+
+	memcpy(dup, str, len);
+	dup[len] = '\0';
+	doc->pool_length += len + 1;
+	return dup;
+}
+
+static jsonrpc_sax_value_t *	sax_add (jsonrpc_sax_doc_t *doc, jsonrpc_type_t type)
+{
+	jsonrpc_sax_value_t	*node;
+
+	if (doc->depth == 0 && doc->count > 0)
+		return NULL;	// more than one root
+	if (!sax_reserve((void **)&doc->nodes, &doc->alloc, doc->count + 1, sizeof(jsonrpc_sax_value_t)))
+		return NULL;
+	if (doc->depth > 0)
+	{
+		if (!sax_reserve((void **)&doc->pending, &doc->pending_alloc, doc->pending_count + 1, sizeof(jsonrpc_sax_slot_t)))
+			return NULL;
+		doc->pending[doc->pending_count++].index = doc->count;
+	}
+
+	node = doc->nodes + doc->count++;
+	memset(node, 0, sizeof(jsonrpc_sax_value_t));
+	node->type = type;
+	node->key  = doc->key;
+	doc->key   = NULL;
+	return node;
+}
+
+static int	sax_null (void *ctx)
+{
+	return sax_add((jsonrpc_sax_doc_t *)ctx, JSONRPC_TYPE_NULL) != NULL;
+}
+
+static int	sax_boolean (void *ctx, int boolean)
+{
+	jsonrpc_sax_value_t *node = sax_add((jsonrpc_sax_doc_t *)ctx, JSONRPC_TYPE_BOOLEAN);
+
+	if (node == NULL)
+		return 0;
+	node->u.boolean = boolean ? JSONRPC_TRUE : JSONRPC_FALSE;
+	return 1;
+}
+
+static int	sax_number (void *ctx, const char *number, size_t len)
+{
+	jsonrpc_sax_value_t *node = sax_add((jsonrpc_sax_doc_t *)ctx, JSONRPC_TYPE_NUMBER);
+	char	buf[64];
+	char	*str = buf;
+
+	if (node == NULL)
+		return 0;
+	if (len >= sizeof(buf))
+	{
+		// long literal (many digits or a padded mantissa): copy it to the heap
+		str = (char *)jsonrpc_malloc(len + 1);
+		if (str == NULL)
+			return 0;
+	}
+	memcpy(str, number, len);
+	str[len] = '\0';
+
+	node->u.number = 0.0;
+	if (strpbrk(str, ".eE") == NULL)
+	{
+		errno = 0;
+		node->u.integer = (int64_t)strtoll(str, NULL, 10);
+		if (errno == 0)
+			node->type = JSONRPC_TYPE_INTEGER;
+	}
+	if (node->type == JSONRPC_TYPE_NUMBER)
+		node->u.number = strtod(str, NULL);
+
+	if (str != buf)
+		jsonrpc_free(str);
+	return 1;
+}
+
+static int	sax_string (void *ctx, const unsigned char *str, size_t len)
+{
+	jsonrpc_sax_doc_t	*doc  = (jsonrpc_sax_doc_t *)ctx;
+	jsonrpc_sax_value_t	*node = sax_add(doc, JSONRPC_TYPE_STRING);
+
+	if (node == NULL)
+		return 0;
+	node->u.string = (char *)sax_strdup(doc, str, len);
+	node->length   = len;
+	return 1;
+}
+
+static int	sax_map_key (void *ctx, const unsigned char *key, size_t len)
+{
+	jsonrpc_sax_doc_t	*doc = (jsonrpc_sax_doc_t *)ctx;
+
+	doc->key = sax_strdup(doc, key, len);
+	return 1;
+}
+
+static int	sax_start (jsonrpc_sax_doc_t *doc, jsonrpc_type_t type)
+{
+	if (sax_add(doc, type) == NULL)
+		return 0;
+	if (!sax_reserve((void **)&doc->stack, &doc->stack_alloc, doc->depth + 1, sizeof(doc->stack[0])))
+		return 0;
+	doc->stack[doc->depth].node    = doc->count - 1;
+	doc->stack[doc->depth].pending = doc->pending_count;
+	doc->depth++;
+	return 1;
+}
+
+static int	sax_end (jsonrpc_sax_doc_t *doc)
+{
+	jsonrpc_sax_value_t	*node;
+	size_t	first, n;
+
+	doc->depth--;
+	node  = doc->nodes + doc->stack[doc->depth].node;
+	first = doc->stack[doc->depth].pending;
+	n     = doc->pending_count - first;
+	if (!sax_reserve((void **)&doc->children, &doc->children_alloc, doc->children_count + n, sizeof(jsonrpc_sax_slot_t)))
+		return 0;
+
+	// move the children of this container into their final, contiguous place
+	node->length  = n;
+	node->u.first = doc->children_count;
+	if (n > 0)
+		memcpy(doc->children + doc->children_count, doc->pending + first, n * sizeof(jsonrpc_sax_slot_t));
+	doc->children_count += n;
+	doc->pending_count   = first;
+	return 1;
+}
+
+static int	sax_start_map (void *ctx)
+{
+	return sax_start((jsonrpc_sax_doc_t *)ctx, JSONRPC_TYPE_OBJECT);
+}
+
+static int	sax_start_array (void *ctx)
+{
+	return sax_start((jsonrpc_sax_doc_t *)ctx, JSONRPC_TYPE_ARRAY);
+}
+
+static int	sax_end_container (void *ctx)
+{
+	return sax_end((jsonrpc_sax_doc_t *)ctx);
+}
+
+// yajl allocates with the allocator of the server too
+static void *	sax_malloc (void *ctx, size_t size)
+{
+	(void)ctx;
+	return jsonrpc_malloc(size);
+}
+
+static void *	sax_realloc (void *ctx, void *mem, size_t size)
+{
+	(void)ctx;
+	return jsonrpc_realloc(mem, size);
+}
+
+static void		sax_free (void *ctx, void *mem)
+{
+	(void)ctx;
+	jsonrpc_free(mem);
+}
+
+static jsonrpc_handle_t	jsonrpc_yajl_sax_parse (const char *json)
+{
+	static const yajl_callbacks callbacks = {
+		sax_null,
+		sax_boolean,
+		NULL,
+		NULL,
+		sax_number,
+		sax_string,
+		sax_start_map,
+		sax_map_key,
+		sax_end_container,
+		sax_start_array,
+		sax_end_container
+	};
+	static yajl_alloc_funcs funcs = { sax_malloc, sax_realloc, sax_free, NULL };
+	jsonrpc_sax_doc_t	*doc;
+	yajl_handle	yajl;
+	yajl_status	status;
+	size_t		len, i;
+
+	len = strlen(json);
+	doc = (jsonrpc_sax_doc_t *)jsonrpc_malloc(sizeof(jsonrpc_sax_doc_t) + len + 1);
+	if (doc == NULL)
+		return NULL;
+	memset(doc, 0, sizeof(jsonrpc_sax_doc_t));
+	doc->pool  = (char *)(doc + 1);
+
+	// pre-sized for typical requests, grows by doubling on dense input
+	doc->alloc = len / 8 + 16;
+	doc->nodes = (jsonrpc_sax_value_t *)jsonrpc_malloc(doc->alloc * sizeof(jsonrpc_sax_value_t));
+	if (doc->nodes == NULL)
+		goto ERROR;
+
+	yajl = yajl_alloc(&callbacks, &funcs, doc);
+	if (yajl == NULL)
+		goto ERROR;
+	status = yajl_parse(yajl, (const unsigned char *)json, len);
+	if (status == yajl_status_ok)
+		status = yajl_complete_parse(yajl);
+	yajl_free(yajl);
+	if (status != yajl_status_ok || doc->count == 0)
+		goto ERROR;
+
+	// resolve child indices into pointers
+	for (i = 0 ; i < doc->children_count ; i++)
+		doc->children[i].value = doc->nodes + doc->children[i].index;
+	for (i = 0 ; i < doc->count ; i++)
+	{
+		if (doc->nodes[i].type == JSONRPC_TYPE_OBJECT || doc->nodes[i].type == JSONRPC_TYPE_ARRAY)
+			doc->nodes[i].u.items = doc->children + doc->nodes[i].u.first;
+	}
+
+	jsonrpc_free(doc->pending);
+	jsonrpc_free(doc->stack);
+	doc->pending = NULL;
+	doc->stack   = NULL;
+
+	memcpy(&doc->root, doc->nodes, sizeof(jsonrpc_sax_value_t));	// nobody refers to the root node
+	return (jsonrpc_handle_t)doc;
+ERROR:
+	jsonrpc_free(doc->nodes);
+	jsonrpc_free(doc->children);
+	jsonrpc_free(doc->pending);
+	jsonrpc_free(doc->stack);
+	jsonrpc_free(doc);
+	return NULL;
+}
+
+static void				jsonrpc_yajl_sax_release (jsonrpc_handle_t json)
+{
+	jsonrpc_sax_doc_t	*doc = (jsonrpc_sax_doc_t *)json;
+
+	if (doc)
+	{
+		jsonrpc_free(doc->nodes);
+		jsonrpc_free(doc->children);
+		jsonrpc_free(doc);
+	}
+}
+
+static jsonrpc_handle_t	jsonrpc_yajl_sax_get    (jsonrpc_handle_t json, const char *key)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+	size_t	i;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return NULL;
+
+	for (i = 0 ; i < v->length ; i++)
+	{
+		if (strcmp(v->u.items[i].value->key, key) == 0)
+			return (jsonrpc_handle_t)v->u.items[i].value;
+	}
+	return NULL;
+}
+
+static void				jsonrpc_yajl_sax_get_members (jsonrpc_handle_t json, const char * const *keys, size_t n, jsonrpc_handle_t *values)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+	size_t	i, k;
+
+	for (k = 0 ; k < n ; k++)
+		values[k] = NULL;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return;
+
+	for (i = 0 ; i < v->length ; i++)
+	{
+		for (k = 0 ; k < n ; k++)
+		{
+			if (values[k] == NULL && strcmp(v->u.items[i].value->key, keys[k]) == 0)
+			{
+				values[k] = (jsonrpc_handle_t)v->u.items[i].value;
+				break;
+			}
+		}
+	}
+}
+
+static jsonrpc_handle_t	jsonrpc_yajl_sax_get_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+
+	if ((v->type == JSONRPC_TYPE_OBJECT || v->type == JSONRPC_TYPE_ARRAY) && index < v->length)
+		return (jsonrpc_handle_t)v->u.items[index].value;
+	return NULL;
+}
+
+static const char *		jsonrpc_yajl_sax_get_key_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT && index < v->length)
+		return v->u.items[index].value->key;
+	return NULL;
+}
+
+static jsonrpc_bool_t	jsonrpc_yajl_sax_valueof (jsonrpc_handle_t json, jsonrpc_json_t *value)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+
+	value->type   = v->type;
+	value->length = 0;
+	switch (v->type)
+	{
+	case JSONRPC_TYPE_NUMBER:
+		value->u.number = v->u.number;
+		break;
+
+	case JSONRPC_TYPE_INTEGER:
+		value->u.integer = v->u.integer;
+		break;
+
+	case JSONRPC_TYPE_BOOLEAN:
+		value->u.boolean = v->u.boolean;
+		break;
+
+	case JSONRPC_TYPE_STRING:
+		value->u.string = v->u.string;
+		value->length   = v->length;
+		break;
+
+	case JSONRPC_TYPE_OBJECT:
+	case JSONRPC_TYPE_ARRAY:
+		value->u.object = json;
+		break;
+
+	case JSONRPC_TYPE_NULL:
+		break;
+
+	default:
+		return JSONRPC_FALSE;
+	}
+	return JSONRPC_TRUE;
+}
+
+static size_t			jsonrpc_yajl_sax_length (jsonrpc_handle_t json)
+{
+	jsonrpc_sax_value_t	*v = (jsonrpc_sax_value_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT || v->type == JSONRPC_TYPE_ARRAY)
+		return v->length;
+	return 0;
+}
+
+
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_yajl_sax (void)
+{
+	static const jsonrpc_json_plugin_t plugin_yajl_sax = {
+		jsonrpc_yajl_sax_parse,
+		jsonrpc_yajl_sax_release,
+		jsonrpc_yajl_sax_get,
+		jsonrpc_yajl_sax_get_at,
+		jsonrpc_yajl_sax_get_key_at,
+		jsonrpc_yajl_sax_valueof,
+		jsonrpc_yajl_sax_length,
+		jsonrpc_yajl_sax_get_members,
+		NULL,
+		JSONRPC_TRUE	// yajl validates the UTF-8 of strings
+	};
+	return &plugin_yajl_sax;
+}
+
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef jsonrpc_jsonrpc_plugin_yajl_sax_h
+#define jsonrpc_jsonrpc_plugin_yajl_sax_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <jsonrpc.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * yajl json plugin built on the callback (SAX) parser.
+ * Values are captured into one flat array while parsing, no yajl_tree is built.
+ */
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_yajl_sax (void);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
+
@@ -13,6 +13,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <ctype.h>
 
 #include "jsonrpc_config.h"
@@ -48,6 +50,7 @@ typedef enum
  */
 typedef enum {
 	JSONRPC_TYPE_NUMBER    = 'i',
+	JSONRPC_TYPE_INTEGER   = 'l',	///< number without fraction and exponent that fits in 64 bits
 	JSONRPC_TYPE_BOOLEAN   = 'b',
 	JSONRPC_TYPE_STRING    = 's',
 	JSONRPC_TYPE_ARRAY	   = 'a',
@@ -55,7 +58,7 @@ typedef enum {
 	JSONRPC_TYPE_NULL	   = 'n',
 	JSONRPC_TYPE_UNDEFINED = 'u'
 } jsonrpc_type_t;
-#define JSONRPC_TYPES		"ibsaonu"
+#define JSONRPC_TYPES		"ilbsaonu"
 
 /**
  * JSON-RPC boolean type
@@ -67,6 +70,109 @@ typedef enum {
 
 typedef void *	jsonrpc_handle_t;	///< handle type (general purpose)
 
+/**
+ * response buffer of the caller
+ */
+typedef struct
+{
+	char			*buf;
+	size_t			size;
+	/**
+	 * (optional) Grow 'buf' to 'size' bytes, keeping its content (like realloc).
+	 * Return NULL to refuse; the response is then finished in memory of the server.
+	 */
+	char *			(* grow) (void *ctx, char *buf, size_t size);
+	void			*ctx;	///< context of 'grow'
+} jsonrpc_buffer_t;
+
+/**
+ * piece of a response (to copy into a 'struct iovec' for writev/sendmsg)
+ */
+typedef struct
+{
+	const char		*base;
+	size_t			length;
+} jsonrpc_iovec_t;
+
+/**
+ * JSON-RPC allocator (see jsonrpc_server_open_ex())
+ */
+typedef struct
+{
+	void *			(* _malloc) (size_t n, void *userdata);
+	void *			(* _realloc) (void *mem, size_t n, void *userdata);
+	void			(* _free) (void *mem, void *userdata);
+	void			*userdata;
+} jsonrpc_allocator_t;
+
+/**
+ * bounds of the requests a server is sized for (see jsonrpc_server_preallocate())
+ */
+typedef struct
+{
+	size_t			request;	///< bytes of a request
+	size_t			response;	///< bytes of a response (the whole response of a batch)
+	size_t			params;		///< params of a call
+	size_t			batch;		///< calls of a batch
+} jsonrpc_limits_t;
+
+/**
+ * called on every allocator call of a server in steady state (see jsonrpc_server_preallocate())
+ *
+ * @param size		bytes asked for (0 for a free)
+ * @param userdata	as given to jsonrpc_server_set_alloc_hook()
+ */
+typedef void (* jsonrpc_alloc_hook_t) (size_t size, void *userdata);
+
+/**
+ * classes of the scratch memory of a server (see jsonrpc_server_get_memory_stats())
+ */
+typedef enum
+{
+	  JSONRPC_MEMORY_STREAMS		///< response streams
+	, JSONRPC_MEMORY_TEXT			///< copies of the requests
+	, JSONRPC_MEMORY_PARAMS			///< params of the calls
+	, JSONRPC_MEMORY_ARENA			///< arenas of the requests
+	, JSONRPC_MEMORY_BATCH			///< calls and pieces of the batches
+	, JSONRPC_MEMORY_CLASSES
+} jsonrpc_memory_class_t;
+
+typedef struct
+{
+	size_t			live;		///< bytes held now
+	size_t			peak;		///< most bytes held at once
+} jsonrpc_memory_usage_t;
+
+typedef struct
+{
+	jsonrpc_memory_usage_t	total;		///< everything the server allocated (all its threads)
+	jsonrpc_memory_usage_t	classes[JSONRPC_MEMORY_CLASSES];	///< scratch memory of the server and its batch workers, as of the end of the last request
+	size_t			refused;	///< allocations refused by JSONRPC_OPTION_MEMORY_LIMIT
+} jsonrpc_memory_stats_t;
+
+/**
+ * JSON-RPC arena (bump allocator)
+ * memory from the arena is released all together when the arena is reset.
+ */
+typedef struct jsonrpc_arena	jsonrpc_arena_t;
+
+/**
+ * flags of jsonrpc_arena_open()
+ */
+typedef enum
+{
+	  JSONRPC_ARENA_HUGEPAGE	= 1	///< back the chunks with huge pages where the system has them (else the heap)
+} jsonrpc_arena_flag_t;
+
+/**
+ * position in an arena, to release what was allocated after it (see jsonrpc_arena_rewind())
+ */
+typedef struct
+{
+	void			*chunk;
+	size_t			used;
+} jsonrpc_arena_mark_t;
+
 /**
  * JSON-RPC json type
  *
@@ -74,9 +180,11 @@ typedef void *	jsonrpc_handle_t;	///< handle type (general purpose)
 typedef struct
 {
 	jsonrpc_type_t		type;		///< type of the value
+	size_t				length;		///< byte length of a string value (0 for other types)
 	union
 	{
 		double				number;		///< number value
+		int64_t				integer;	///< integer value
 		jsonrpc_bool_t		boolean;	///< boolean value
 		char				*string;	///< string value
 		jsonrpc_handle_t	array;		///< array json handle
@@ -111,6 +219,27 @@ typedef struct
 	const char *		(* get_key_at) (jsonrpc_handle_t json, size_t index);
 	jsonrpc_bool_t		(* valueof) (jsonrpc_handle_t json, jsonrpc_json_t *value);
 	size_t				(* length) (jsonrpc_handle_t json);
+
+	/**
+	 * (optional) Look up several members of an object in one pass.
+	 * 'values[i]' is set to the first member named 'keys[i]', or NULL if there is none.
+	 * If not implemented, the server falls back to 'get'.
+	 */
+	void				(* get_members) (jsonrpc_handle_t json, const char * const *keys, size_t n, jsonrpc_handle_t *values);
+
+	/**
+	 * (optional) Parse 'json' destructively in place.
+	 * The plugin may modify 'json' and hand out pointers into it, and allocates from 'arena'.
+	 * Both belong to the server and stay valid until the returned handle is released.
+	 * If implemented, the server uses this instead of 'parse'.
+	 */
+	jsonrpc_handle_t	(* parse_insitu) (char *json, size_t length, jsonrpc_arena_t *arena);
+
+	/**
+	 * (optional) JSONRPC_TRUE if the parser rejects malformed UTF-8 itself.
+	 * Otherwise the server checks every request before handing it to the plugin.
+	 */
+	jsonrpc_bool_t		validates_utf8;
 } jsonrpc_json_plugin_t;
 
 /**
@@ -124,15 +253,42 @@ typedef struct
 	const char *		(* recv ) (jsonrpc_handle_t net, unsigned int timeout, void **desc);
 	jsonrpc_error_t		(* send ) (jsonrpc_handle_t net, const char *data, void *desc);
 	jsonrpc_error_t		(* error) (jsonrpc_handle_t net);
+
+	/**
+	 * (optional) Send a part of a response.
+	 * 'more' is JSONRPC_FALSE for the last part of the response.
+	 * If implemented, the server sends the response of a batch piece by piece
+	 * as the calls finish, instead of building it up and using 'send'.
+	 */
+	jsonrpc_error_t		(* send_partial) (jsonrpc_handle_t net, const char *data, size_t length, jsonrpc_bool_t more, void *desc);
+
+	/**
+	 * (optional) Send a response made of 'count' pieces (with writev/sendmsg, say).
+	 * If implemented (and 'send_partial' is not), the server hands the response
+	 * over in place: the calls of a batch run on the batch threads are not
+	 * copied into one buffer.
+	 */
+	jsonrpc_error_t		(* sendv) (jsonrpc_handle_t net, const jsonrpc_iovec_t *iov, size_t count, void *desc);
 } jsonrpc_net_plugin_t;
 
+/**
+ * JSON-RPC result writer
+ * appends the result of a method to the response as it is written, with
+ * commas and string escapes taken care of.
+ * the 'ctx' of a method is its writer, so a method can write its result with
+ * jsonrpc_writer_*((jsonrpc_writer_t *)ctx, ...) instead of 'print_result'.
+ * (the two should not be mixed for the same array or object)
+ */
+typedef struct jsonrpc_writer	jsonrpc_writer_t;
+
 /**
  * JSON-RPC method
  * -
  * @param	argc	argument count
  * @param	argv	arguments
- * @param	print_result	write result
- * @param	ctx		print context
+ * @param	print_result	write result (printf-like), NULL for a notification
+ * @param	ctx		print context (jsonrpc_writer_t of the result).
+ *					a notification gets one too, for jsonrpc_writer_alloc(); what it writes is dropped.
  */
 typedef jsonrpc_error_t (* jsonrpc_method_t) (
 								int argc
@@ -141,6 +297,51 @@ typedef jsonrpc_error_t (* jsonrpc_method_t) (
 								, void *ctx
 							);
 
+/**
+ * JSON-RPC response output
+ * -
+ * @param	ctx		output context
+ * @param	data	part of the response (not NUL-terminated)
+ * @param	length	byte length of 'data'
+ * @param	more	JSONRPC_FALSE for the last part of the response
+ */
+typedef jsonrpc_error_t (* jsonrpc_output_t) (void *ctx, const char *data, size_t length, jsonrpc_bool_t more);
+
+/**
+ * Result writer functions.
+ * A failed call (out of memory, unbalanced nesting, a key outside an object, a second result)
+ * makes the method fail with that error, and later calls do nothing.
+ *
+ * @return JSONRPC_ERROR_OK, or the first error of the writer
+ */
+jsonrpc_error_t	jsonrpc_writer_begin_object (jsonrpc_writer_t *self);
+jsonrpc_error_t	jsonrpc_writer_end_object (jsonrpc_writer_t *self);
+jsonrpc_error_t	jsonrpc_writer_begin_array (jsonrpc_writer_t *self);
+jsonrpc_error_t	jsonrpc_writer_end_array (jsonrpc_writer_t *self);
+jsonrpc_error_t	jsonrpc_writer_key (jsonrpc_writer_t *self, const char *name);	///< member name; the value follows
+jsonrpc_error_t	jsonrpc_writer_number (jsonrpc_writer_t *self, double value);	///< NaN and infinities as null
+jsonrpc_error_t	jsonrpc_writer_int64 (jsonrpc_writer_t *self, int64_t value);
+jsonrpc_error_t	jsonrpc_writer_boolean (jsonrpc_writer_t *self, jsonrpc_bool_t value);
+jsonrpc_error_t	jsonrpc_writer_null (jsonrpc_writer_t *self);
+jsonrpc_error_t	jsonrpc_writer_string (jsonrpc_writer_t *self, const char *str, size_t length);	///< UTF-8, escaped as needed
+jsonrpc_error_t	jsonrpc_writer_raw (jsonrpc_writer_t *self, const char *json, size_t length);	///< JSON text as it is
+
+/**
+ * Scratch memory of a method, from the arena of the request it is called for:
+ * there is nothing to free, everything goes at once after the response is written
+ * (see jsonrpc_exec_ctx_get_arena()). The memory is not shared with other threads,
+ * including the batch workers.
+ *
+ * @return 'size' bytes, or NULL if out of memory
+ */
+void *	jsonrpc_writer_alloc (jsonrpc_writer_t *self, size_t size);
+
+/**
+ * The arena behind jsonrpc_writer_alloc(), to give back some of it earlier with
+ * jsonrpc_arena_mark() and jsonrpc_arena_rewind() (NULL if out of memory).
+ */
+jsonrpc_arena_t *	jsonrpc_writer_get_arena (jsonrpc_writer_t *self);
+
 
 
 
@@ -150,6 +351,62 @@ typedef jsonrpc_error_t (* jsonrpc_method_t) (
  */
 typedef struct jsonrpc_server	jsonrpc_server_t;
 
+/**
+ * JSON-RPC execution context
+ * scratch memory for executing requests against a server from one thread.
+ * each thread has its own context, while all of them share the methods and
+ * plug-ins of the server without locking.
+ */
+typedef struct jsonrpc_exec_ctx	jsonrpc_exec_ctx_t;
+
+/**
+ * JSON-RPC server options
+ * @see jsonrpc_server_set_option
+ */
+typedef enum
+{
+	/**
+	 * number of worker threads that run the calls of a batch concurrently
+	 * (default 0: one after another on the calling thread).
+	 * methods must be thread-safe when this is set.
+	 * the workers serve jsonrpc_server_execute(); a jsonrpc_exec_ctx_t runs
+	 * the calls of its batches on its own thread.
+	 */
+	  JSONRPC_OPTION_BATCH_THREADS
+	, JSONRPC_OPTION_BATCH_ORDER		///< order of batch responses (jsonrpc_batch_order_t)
+	/**
+	 * a batch of at least this many bytes is cut into its elements before parsing
+	 * (default 0: never). every element is then parsed and executed on its own,
+	 * on the batch threads if there are any, so only the elements in flight are
+	 * kept parsed. a malformed element gets a "Parse error" response of its own
+	 * as long as the brackets and strings of the batch are balanced.
+	 */
+	, JSONRPC_OPTION_BATCH_SPLIT
+	/**
+	 * non-zero: the arenas of the requests are backed by huge pages (JSONRPC_ARENA_HUGEPAGE).
+	 * applies to the server and its batch workers, and to the contexts opened afterwards.
+	 */
+	, JSONRPC_OPTION_ARENA_HUGEPAGE
+	/**
+	 * scratch buffers grown beyond this many bytes by a request are shrunk back
+	 * when the next one starts, as the response lives in them until then
+	 * (default 0: kept for the next requests). the buffers of
+	 * jsonrpc_server_preallocate() are never trimmed below their size.
+	 */
+	, JSONRPC_OPTION_TRIM_THRESHOLD
+	/**
+	 * most bytes the server may hold at once (default 0: no limit).
+	 * a request that needs more is answered with JSONRPC_ERROR_SERVER_OUT_OF_MEMORY.
+	 */
+	, JSONRPC_OPTION_MEMORY_LIMIT
+} jsonrpc_option_t;
+
+typedef enum
+{
+	  JSONRPC_BATCH_ORDER_REQUEST		///< same order as the calls (default)
+	, JSONRPC_BATCH_ORDER_COMPLETION	///< in the order the calls finish
+} jsonrpc_batch_order_t;
+
 jsonrpc_server_t *
 jsonrpc_server_open (
 				const jsonrpc_json_plugin_t *ijson
@@ -157,6 +414,22 @@ jsonrpc_server_open (
 				, ...
 			);
 
+/**
+ * Same as jsonrpc_server_open(), with all the memory of the server (its streams,
+ * scratch buffers, batch workers, and the plugins while they work for it)
+ * coming from 'allocator'. It is copied: later jsonrpc_set_alloc_funcs() calls
+ * do not change it.
+ *
+ * @param allocator	allocator of the server (NULL: the one of the calling thread, see jsonrpc_set_thread_allocator())
+ */
+jsonrpc_server_t *
+jsonrpc_server_open_ex (
+				const jsonrpc_allocator_t *allocator
+				, const jsonrpc_json_plugin_t *ijson
+				, const jsonrpc_net_plugin_t *inet
+				, ...
+			);
+
 void
 jsonrpc_server_close (jsonrpc_server_t *self);
 
@@ -172,10 +445,188 @@ jsonrpc_server_register_method (
 const char *
 jsonrpc_server_execute (jsonrpc_server_t *self, const char *request);
 
+/**
+ * Execute a request and hand the response to 'output'.
+ * The response of a batch is written piece by piece as soon as each call is done
+ * (in the order set by JSONRPC_OPTION_BATCH_ORDER), so the first calls can be
+ * answered before the last ones finish. Nothing is written if there is nothing
+ * to respond (notifications only).
+ *
+ * @return the first error returned by 'output', or JSONRPC_ERROR_OK
+ */
+jsonrpc_error_t
+jsonrpc_server_execute_stream (jsonrpc_server_t *self, const char *request, jsonrpc_output_t output, void *ctx);
+
+/**
+ * Execute a request and write the response ('\0' terminated) into the buffer of the caller,
+ * so that it can be rendered straight into a send buffer (after some headroom, say).
+ * 'out->buf' and 'out->size' are updated to where the response is: the buffer of the
+ * caller (grown by 'out->grow'), or memory of the server valid until the next request
+ * if the buffer was too small and could not grow. The caller keeps track of its buffer.
+ *
+ * @return length of the response (0 if there is nothing to respond, or out of memory)
+ */
+size_t
+jsonrpc_server_execute_into (jsonrpc_server_t *self, const char *request, jsonrpc_buffer_t *out);
+
+/**
+ * Execute a request and get the response as pieces in place, to send with
+ * writev/sendmsg. The response of a batch run on the batch threads is not
+ * copied into one buffer; any other response is a single piece.
+ * The pieces are valid until the next request executed.
+ *
+ * @return number of pieces (0 if there is nothing to respond, or out of memory)
+ */
+size_t
+jsonrpc_server_execute_iov (jsonrpc_server_t *self, const char *request, const jsonrpc_iovec_t **iov);
+
+/**
+ * Open an execution context of 'server'.
+ * Methods are registered and options set on the server before contexts execute requests.
+ */
+jsonrpc_exec_ctx_t *
+jsonrpc_exec_ctx_open (jsonrpc_server_t *server);
+
+void
+jsonrpc_exec_ctx_close (jsonrpc_exec_ctx_t *self);
+
+/**
+ * Get the arena of the request being executed in 'self'.
+ * Everything allocated from it is released at once when the next request starts
+ * (or, in jsonrpc_server_run(), as soon as the response has been sent).
+ *
+ * @return the arena, or NULL if out of memory
+ */
+jsonrpc_arena_t *
+jsonrpc_exec_ctx_get_arena (jsonrpc_exec_ctx_t *self);
+
+/**
+ * Same as jsonrpc_exec_ctx_get_arena(), for the requests of jsonrpc_server_execute() and jsonrpc_server_run().
+ */
+jsonrpc_arena_t *
+jsonrpc_server_get_arena (jsonrpc_server_t *self);
+
+/**
+ * Same as jsonrpc_server_execute(), with the scratch memory of 'self'.
+ * Threads may execute concurrently as long as each one uses its own context.
+ * The response is valid until the next request executed in 'self'.
+ */
+const char *
+jsonrpc_exec_ctx_execute (jsonrpc_exec_ctx_t *self, const char *request);
+
+/**
+ * Same as jsonrpc_server_execute_stream(), with the scratch memory of 'self'.
+ */
+jsonrpc_error_t
+jsonrpc_exec_ctx_execute_stream (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_output_t output, void *ctx);
+
+/**
+ * Same as jsonrpc_server_execute_into(), with the scratch memory of 'self'.
+ */
+size_t
+jsonrpc_exec_ctx_execute_into (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_buffer_t *out);
+
+/**
+ * Same as jsonrpc_server_execute_iov(), with the scratch memory of 'self'.
+ */
+size_t
+jsonrpc_exec_ctx_execute_iov (jsonrpc_exec_ctx_t *self, const char *request, const jsonrpc_iovec_t **iov);
+
 jsonrpc_error_t
 jsonrpc_server_run (jsonrpc_server_t *self, unsigned int timeout);
 
+/**
+ * Set a server option.
+ * Not while the server is executing a request.
+ *
+ * @return JSONRPC_ERROR_INVALID_PARAMS for an unknown option or bad value
+ */
+jsonrpc_error_t
+jsonrpc_server_set_option (jsonrpc_server_t *self, jsonrpc_option_t option, long value);
+
+/**
+ * Allocate the scratch memory of the server, of its batch workers and of the contexts
+ * opened afterwards for requests within 'limits', and put the server in steady state:
+ * executing such a request then calls the allocator zero times (given a json plug-in
+ * that parses in place, and a jsonrpc_server_execute_into() buffer of 'limits->response'
+ * bytes). Any allocator call made for a request from then on is reported to the hook
+ * of jsonrpc_server_set_alloc_hook(); without one, it fails an assertion in debug builds.
+ * Options set later keep the memory preallocated. Not while the server is executing a request.
+ *
+ * @return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, or JSONRPC_ERROR_OK
+ */
+jsonrpc_error_t
+jsonrpc_server_preallocate (jsonrpc_server_t *self, const jsonrpc_limits_t *limits);
+
+/**
+ * Set the hook called on the allocations of the requests in steady state
+ * (NULL: an assertion in debug builds). The allocation goes ahead either way.
+ */
+void
+jsonrpc_server_set_alloc_hook (jsonrpc_server_t *self, jsonrpc_alloc_hook_t hook, void *userdata);
+
+/**
+ * Get the memory held by a server: in total, and per class of scratch memory.
+ * Not while the server is executing a request.
+ */
+void
+jsonrpc_server_get_memory_stats (jsonrpc_server_t *self, jsonrpc_memory_stats_t *stats);
+
+
+/**
+ * Open an arena which allocates in chunks of (at least) 'chunk_size' bytes.
+ *
+ * @param flags	jsonrpc_arena_flag_t values or'ed together
+ * @return instance of 'jsonrpc_arena_t', or NULL if out of memory
+ */
+jsonrpc_arena_t *
+jsonrpc_arena_open (size_t chunk_size, unsigned int flags);
+
+/**
+ * Release everything allocated from the arena at once. (chunks are kept for reuse)
+ */
+void
+jsonrpc_arena_reset (jsonrpc_arena_t *arena);
+
+/**
+ * Reset the arena, with room for 'size' bytes in its first chunk.
+ *
+ * @return JSONRPC_FALSE if out of memory
+ */
+jsonrpc_bool_t
+jsonrpc_arena_reserve (jsonrpc_arena_t *arena, size_t size);
+
+/**
+ * Close the arena, and give its chunks back.
+ */
+void
+jsonrpc_arena_close (jsonrpc_arena_t *arena);
+
+/**
+ * Where the arena is now, to go back there with jsonrpc_arena_rewind()
+ */
+jsonrpc_arena_mark_t
+jsonrpc_arena_mark (jsonrpc_arena_t *arena);
+
+/**
+ * Release everything allocated since 'mark' (marks taken after it become invalid).
+ */
+void
+jsonrpc_arena_rewind (jsonrpc_arena_t *arena, jsonrpc_arena_mark_t mark);
+
+/**
+ * Allocate 'size' bytes from the arena.
+ * The memory is valid until the arena is reset; it can not be freed individually.
+ *
+ * @return aligned memory, or NULL if out of memory
+ */
+void *
+jsonrpc_arena_alloc (jsonrpc_arena_t *arena, size_t size);
 
+/**
+ * Set the allocator of the process, used by the threads that have none of their own.
+ * Servers keep the allocator they are opened with.
+ */
 void
 jsonrpc_set_alloc_funcs (
 				  void * (* _malloc) (size_t n, void *userdata)
@@ -183,6 +634,32 @@ jsonrpc_set_alloc_funcs (
 				, void (* _free)(void *mem, void *userdata)
 				, void *userdata
 			);
+
+/**
+ * Set the allocator of the calling thread (such as a pool local to its NUMA node),
+ * used instead of the one of the process by the servers opened on it afterwards,
+ * and by the plugins called outside a server.
+ * A server makes its own allocator the one of the thread while it works for it.
+ *
+ * @param allocator	allocator of the thread (NULL: the one of the process). It must outlive its use.
+ * @return the previous allocator of the thread (NULL if none)
+ */
+const jsonrpc_allocator_t *
+jsonrpc_set_thread_allocator (const jsonrpc_allocator_t *allocator);
+
+/**
+ * Same as malloc(), realloc() and free(), with the allocator of the calling thread:
+ * the one of the server while a plugin works for it (see jsonrpc_set_thread_allocator()).
+ * Plugins allocate their documents with these so the memory is that of the server.
+ */
+void *
+jsonrpc_malloc (size_t size);
+
+void *
+jsonrpc_realloc (void *mem, size_t size);
+
+void
+jsonrpc_free (void *mem);
 #ifdef  __cplusplus
 }
 #endif
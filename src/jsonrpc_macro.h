@@ -31,6 +31,33 @@ extern "C" {
 	} else {}
 #endif
 
+#if defined(_MSC_VER)
+#define	JSONRPC_THREAD_LOCAL	__declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define	JSONRPC_THREAD_LOCAL	__thread
+#else
+#define	JSONRPC_THREAD_LOCAL	_Thread_local
+#endif
+
+/**
+ * atomic operations on size_t: the new value, and whether 'p' went from 'o' to 'n'
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define	JSONRPC_ATOMIC_ADD(p, n)		__sync_add_and_fetch((p), (n))
+#define	JSONRPC_ATOMIC_CAS(p, o, n)		__sync_bool_compare_and_swap((p), (o), (n))
+#elif defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#define	JSONRPC_ATOMIC_ADD(p, n)		((size_t)_InterlockedExchangeAdd64((volatile __int64 *)(p), (__int64)(n)) + (n))
+#define	JSONRPC_ATOMIC_CAS(p, o, n)		(_InterlockedCompareExchange64((volatile __int64 *)(p), (__int64)(n), (__int64)(o)) == (__int64)(o))
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define	JSONRPC_ATOMIC_ADD(p, n)		((size_t)_InterlockedExchangeAdd((volatile long *)(p), (long)(n)) + (n))
+#define	JSONRPC_ATOMIC_CAS(p, o, n)		(_InterlockedCompareExchange((volatile long *)(p), (long)(n), (long)(o)) == (long)(o))
+#else
+#define	JSONRPC_ATOMIC_ADD(p, n)		(*(p) += (n))	// single threaded
+#define	JSONRPC_ATOMIC_CAS(p, o, n)		(*(p) == (o) ? (*(p) = (n), 1) : 0)
+#endif
+
 #if defined(WIN32) || defined(_WIN32)
 #define	snprintf		_snprintf
 #define	vsnprintf		_vsnprintf
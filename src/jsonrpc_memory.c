@@ -8,8 +8,13 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 #include "jsonrpc.h"
 #include "jsonrpc_memory.h"
+#include "jsonrpc_macro.h"
+#ifdef JSONRPC_HAVE_MMAN
+#include <sys/mman.h>
+#endif
 
 static void *  jsonrpc_default_malloc (size_t size, void *userdata)
 {
@@ -30,28 +35,31 @@ static void    jsonrpc_default_free (void *mem, void *userdata)
     free(mem);
 }
 
-static struct jsonrpc_memory
-{
-    void *  (* _malloc) (size_t, void *);
-    void *  (* _realloc) (void *, size_t, void *);
-    void    (* _free) (void *, void *);
-    void *  userdata;
-} s_memory = {
+static jsonrpc_allocator_t s_memory = {
     jsonrpc_default_malloc,
     jsonrpc_default_realloc,
     jsonrpc_default_free,
     NULL
 };
 
+/**
+ * allocator of the server the thread is working for (NULL: 's_memory')
+ */
+static JSONRPC_THREAD_LOCAL const jsonrpc_allocator_t *	s_current;
+
+#define	JSONRPC_ALLOCATOR()	(s_current ? s_current : &s_memory)
+
 
 void *  jsonrpc_malloc (size_t size)
 {
-    return s_memory._malloc(size, s_memory.userdata);
+    const jsonrpc_allocator_t *a = JSONRPC_ALLOCATOR();
+    return a->_malloc(size, a->userdata);
 }
 
 void    jsonrpc_free (void *mem)
 {
-    s_memory._free(mem, s_memory.userdata);
+    const jsonrpc_allocator_t *a = JSONRPC_ALLOCATOR();
+    a->_free(mem, a->userdata);
 }
 
 void *  jsonrpc_calloc (size_t count, size_t size)
@@ -64,7 +72,13 @@ void *  jsonrpc_calloc (size_t count, size_t size)
 
 void *  jsonrpc_realloc (void *mem, size_t size)
 {
-    return s_memory._realloc(mem, size, s_memory.userdata);
+    const jsonrpc_allocator_t *a = JSONRPC_ALLOCATOR();
+    return a->_realloc(mem, size, a->userdata);
+}
+
+const jsonrpc_allocator_t *	jsonrpc_allocator_current (void)
+{
+    return JSONRPC_ALLOCATOR();
 }
 
 void *	jsonrpc_memdup (const void *mem, size_t size)
@@ -105,6 +119,394 @@ void    jsonrpc_vfree (void *mem, ...)
     va_end(ap);
 }
 
+
+/**
+ * header of a block of a meter
+ */
+typedef union
+{
+	size_t	size;
+	double	align;
+} jsonrpc_meter_block_t;
+
+/**
+ * count 'size' more bytes (as long as they fit in the limit)
+ */
+static jsonrpc_bool_t	jsonrpc_meter_take (jsonrpc_meter_t *meter, size_t size)
+{
+	size_t	live, peak;
+
+	live = JSONRPC_ATOMIC_ADD(&meter->live, size);
+	if (meter->limit && live > meter->limit)
+	{
+		JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - size);
+		JSONRPC_ATOMIC_ADD(&meter->refused, (size_t)1);
+		return JSONRPC_FALSE;
+	}
+	for (peak = JSONRPC_ATOMIC_ADD(&meter->peak, (size_t)0) ; peak < live && !JSONRPC_ATOMIC_CAS(&meter->peak, peak, live) ; )
+		peak = JSONRPC_ATOMIC_ADD(&meter->peak, (size_t)0);
+	return JSONRPC_TRUE;
+}
+
+static void *	jsonrpc_meter_malloc (size_t size, void *userdata)
+{
+	jsonrpc_meter_t			*meter = (jsonrpc_meter_t *)userdata;
+	jsonrpc_meter_block_t	*block;
+
+	if (!jsonrpc_meter_take(meter, size))
+		return NULL;
+	block = (jsonrpc_meter_block_t *)meter->base._malloc(sizeof(jsonrpc_meter_block_t) + size, meter->base.userdata);
+	if (block == NULL)
+	{
+		JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - size);
+		return NULL;
+	}
+	block->size = size;
+	return block + 1;
+}
+
+static void	jsonrpc_meter_free (void *mem, void *userdata)
+{
+	jsonrpc_meter_t			*meter = (jsonrpc_meter_t *)userdata;
+	jsonrpc_meter_block_t	*block;
+
+	if (mem == NULL)
+		return;
+	block = (jsonrpc_meter_block_t *)mem - 1;
+	JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - block->size);
+	meter->base._free(block, meter->base.userdata);
+}
+
+static void *	jsonrpc_meter_realloc (void *mem, size_t size, void *userdata)
+{
+	jsonrpc_meter_t			*meter = (jsonrpc_meter_t *)userdata;
+	jsonrpc_meter_block_t	*block;
+	size_t	old;
+
+	if (mem == NULL)
+		return jsonrpc_meter_malloc(size, userdata);
+	block = (jsonrpc_meter_block_t *)mem - 1;
+	old   = block->size;
+	if (size > old && !jsonrpc_meter_take(meter, size - old))
+		return NULL;
+
+	block = (jsonrpc_meter_block_t *)meter->base._realloc(block, sizeof(jsonrpc_meter_block_t) + size, meter->base.userdata);
+	if (block == NULL)
+	{
+		if (size > old)
+			JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - (size - old));
+		return NULL;
+	}
+	if (size < old)
+		JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - (old - size));
+	block->size = size;
+	return block + 1;
+}
+
+/**
+ * report a call of the guard of 'meter' for 'size' bytes (0: a free)
+ */
+static void	jsonrpc_meter_report (jsonrpc_meter_t *meter, size_t size)
+{
+	if (meter->hook)
+		meter->hook(size, meter->userdata);
+	else
+		assert(!"allocation in steady state");
+}
+
+static void *	jsonrpc_guard_malloc (size_t size, void *userdata)
+{
+	jsonrpc_meter_report((jsonrpc_meter_t *)userdata, size);
+	return jsonrpc_meter_malloc(size, userdata);
+}
+
+static void *	jsonrpc_guard_realloc (void *mem, size_t size, void *userdata)
+{
+	jsonrpc_meter_report((jsonrpc_meter_t *)userdata, size);
+	return jsonrpc_meter_realloc(mem, size, userdata);
+}
+
+static void	jsonrpc_guard_free (void *mem, void *userdata)
+{
+	jsonrpc_meter_report((jsonrpc_meter_t *)userdata, 0);
+	jsonrpc_meter_free(mem, userdata);
+}
+
+void	jsonrpc_meter_init (jsonrpc_meter_t *meter, const jsonrpc_allocator_t *base)
+{
+	memset(meter, 0, sizeof(jsonrpc_meter_t));
+	meter->base = *base;
+	meter->allocator._malloc  = jsonrpc_meter_malloc;
+	meter->allocator._realloc = jsonrpc_meter_realloc;
+	meter->allocator._free    = jsonrpc_meter_free;
+	meter->allocator.userdata = meter;
+	meter->guard._malloc  = jsonrpc_guard_malloc;
+	meter->guard._realloc = jsonrpc_guard_realloc;
+	meter->guard._free    = jsonrpc_guard_free;
+	meter->guard.userdata = meter;
+}
+
+#ifdef JSONRPC_HAVE_MMAN
+/**
+ * meter of the allocator of the calling thread (NULL: it is not one),
+ * once a call for 'size' bytes (0: a free) is reported if it is the guard
+ */
+static jsonrpc_meter_t *	jsonrpc_meter_current (size_t size)
+{
+	const jsonrpc_allocator_t *a = JSONRPC_ALLOCATOR();
+
+	if (a->_malloc == jsonrpc_guard_malloc)
+		jsonrpc_meter_report((jsonrpc_meter_t *)a->userdata, size);
+	else if (a->_malloc != jsonrpc_meter_malloc)
+		return NULL;
+	return (jsonrpc_meter_t *)a->userdata;
+}
+#endif
+
+size_t	jsonrpc_meter_read (const size_t *counter)
+{
+	return JSONRPC_ATOMIC_ADD((size_t *)counter, (size_t)0);
+}
+
+
+#define	JSONRPC_ARENA_ALIGN(n)	(((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+#define	JSONRPC_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+
+typedef struct jsonrpc_arena_chunk
+{
+	struct jsonrpc_arena_chunk	*next;
+	size_t	size;
+	size_t	used;
+	size_t	mapped;		///< length of the mapping (0: from jsonrpc_malloc)
+	jsonrpc_meter_t	*meter;	///< counting the mapping (NULL: none)
+	double	data[1];	///< aligned
+} jsonrpc_arena_chunk_t;
+
+/// most bytes asked of an arena at once (more would overflow the size of a chunk once aligned)
+#define	JSONRPC_ARENA_MAX	(SIZE_MAX - sizeof(double) - offsetof(jsonrpc_arena_chunk_t, data))
+
+struct jsonrpc_arena
+{
+	jsonrpc_arena_chunk_t	*head;
+	jsonrpc_arena_chunk_t	*current;
+	size_t					chunk_size;
+	unsigned int			flags;
+};
+
+#ifdef JSONRPC_HAVE_MMAN
+/**
+ * map a chunk on huge pages (or on a huge page boundary, where the kernel may merge pages into huge pages),
+ * counted by the meter of the thread if any
+ */
+static jsonrpc_arena_chunk_t *	jsonrpc_arena_map (size_t size)
+{
+	jsonrpc_arena_chunk_t *chunk;
+	jsonrpc_meter_t	*meter;
+	size_t	length, head;
+	void	*mem = MAP_FAILED;
+
+	if (size > JSONRPC_ARENA_MAX - 2 * JSONRPC_HUGEPAGE_SIZE)
+		return NULL;
+	length = offsetof(jsonrpc_arena_chunk_t, data) + size;
+	length = (length + JSONRPC_HUGEPAGE_SIZE - 1) & ~((size_t)JSONRPC_HUGEPAGE_SIZE - 1);
+	meter  = jsonrpc_meter_current(length);
+	if (meter && !jsonrpc_meter_take(meter, length))
+		return NULL;
+#ifdef MAP_HUGETLB
+	mem = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (mem == MAP_FAILED)	// no reserved huge pages: transparent ones if any
+	{
+		// one huge page more, trimmed down to the first boundary
+		mem = mmap(NULL, length + JSONRPC_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+		{
+			if (meter)
+				JSONRPC_ATOMIC_ADD(&meter->live, (size_t)0 - length);
+			return NULL;
+		}
+		head = (JSONRPC_HUGEPAGE_SIZE - ((uintptr_t)mem & (JSONRPC_HUGEPAGE_SIZE - 1))) & (JSONRPC_HUGEPAGE_SIZE - 1);
+		if (head)
+			munmap(mem, head);
+		munmap((char *)mem + head + length, JSONRPC_HUGEPAGE_SIZE - head);
+		mem = (char *)mem + head;
+#ifdef MADV_HUGEPAGE
+		(void)madvise(mem, length, MADV_HUGEPAGE);
+#endif
+	}
+	chunk = (jsonrpc_arena_chunk_t *)mem;
+	chunk->mapped = length;
+	chunk->meter  = meter;
+	chunk->size   = length - offsetof(jsonrpc_arena_chunk_t, data);	// the whole mapping is usable
+	return chunk;
+}
+#endif
+
+static jsonrpc_arena_chunk_t *	jsonrpc_arena_chunk (jsonrpc_arena_t *arena, size_t size)
+{
+	jsonrpc_arena_chunk_t *chunk = NULL;
+
+	if (size > JSONRPC_ARENA_MAX)
+		return NULL;
+#ifdef JSONRPC_HAVE_MMAN
+	if (arena->flags & JSONRPC_ARENA_HUGEPAGE)
+		chunk = jsonrpc_arena_map(size);
+#endif
+	if (chunk == NULL)
+	{
+		chunk = (jsonrpc_arena_chunk_t *)jsonrpc_malloc(offsetof(jsonrpc_arena_chunk_t, data) + size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->mapped = 0;
+		chunk->size   = size;
+	}
+	chunk->next = NULL;
+	chunk->used = 0;
+	return chunk;
+}
+
+static void	jsonrpc_arena_unchunk (jsonrpc_arena_chunk_t *chunk)
+{
+#ifdef JSONRPC_HAVE_MMAN
+	if (chunk->mapped)
+	{
+		(void)jsonrpc_meter_current(0);	// reported as a free
+		if (chunk->meter)
+			JSONRPC_ATOMIC_ADD(&chunk->meter->live, (size_t)0 - chunk->mapped);
+		munmap(chunk, chunk->mapped);
+		return;
+	}
+#endif
+	jsonrpc_free(chunk);
+}
+
+jsonrpc_arena_t *	jsonrpc_arena_open (size_t chunk_size, unsigned int flags)
+{
+	jsonrpc_arena_t	*arena;
+
+	if (chunk_size > JSONRPC_ARENA_MAX)
+		return NULL;
+	arena = (jsonrpc_arena_t *)jsonrpc_calloc(1, sizeof(jsonrpc_arena_t));
+	if (arena)
+	{
+		arena->chunk_size = JSONRPC_ARENA_ALIGN(chunk_size);
+		arena->flags      = flags;
+		arena->head = arena->current = jsonrpc_arena_chunk(arena, arena->chunk_size);
+		if (arena->head == NULL)
+		{
+			jsonrpc_free(arena);
+			return NULL;
+		}
+	}
+	return arena;
+}
+
+void *  jsonrpc_arena_alloc (jsonrpc_arena_t *arena, size_t size)
+{
+	jsonrpc_arena_chunk_t	*chunk;
+	void	*mem;
+
+	if (size > JSONRPC_ARENA_MAX)
+		return NULL;
+	size  = JSONRPC_ARENA_ALIGN(size);
+	chunk = arena->current;
+	while (chunk->size - chunk->used < size)
+	{
+		if (chunk->next == NULL || chunk->next->size < size)
+		{
+			jsonrpc_arena_chunk_t *fresh;
+
+			fresh = jsonrpc_arena_chunk(arena, size > arena->chunk_size ? size : arena->chunk_size);
+			if (fresh == NULL)
+				return NULL;
+			fresh->next = chunk->next;
+			chunk->next = fresh;
+		}
+		chunk = chunk->next;
+		chunk->used = 0;	// chunks after 'current' are free since the last reset
+	}
+	arena->current = chunk;
+
+	mem = (char *)chunk->data + chunk->used;
+	chunk->used += size;
+	return mem;
+}
+
+jsonrpc_arena_mark_t	jsonrpc_arena_mark (jsonrpc_arena_t *arena)
+{
+	jsonrpc_arena_mark_t	mark;
+
+	mark.chunk = arena->current;
+	mark.used  = arena->current->used;
+	return mark;
+}
+
+void    jsonrpc_arena_rewind (jsonrpc_arena_t *arena, jsonrpc_arena_mark_t mark)
+{
+	arena->current = (jsonrpc_arena_chunk_t *)mark.chunk;
+	arena->current->used = mark.used;
+}
+
+void    jsonrpc_arena_reset (jsonrpc_arena_t *arena)
+{
+	arena->current = arena->head;
+	arena->head->used = 0;
+}
+
+jsonrpc_bool_t	jsonrpc_arena_reserve (jsonrpc_arena_t *arena, size_t size)
+{
+	jsonrpc_arena_chunk_t	*chunk;
+
+	size = JSONRPC_ARENA_ALIGN(size);
+	if (arena->head->size < size)
+	{
+		chunk = jsonrpc_arena_chunk(arena, size);
+		if (chunk == NULL)
+			return JSONRPC_FALSE;
+		chunk->next = arena->head;
+		arena->head = chunk;
+	}
+	jsonrpc_arena_reset(arena);
+	return JSONRPC_TRUE;
+}
+
+size_t	jsonrpc_arena_capacity (jsonrpc_arena_t *arena)
+{
+	jsonrpc_arena_chunk_t	*chunk;
+	size_t	size = 0;
+
+	for (chunk = arena->head ; chunk ; chunk = chunk->next)
+		size += chunk->size;
+	return size;
+}
+
+void	jsonrpc_arena_trim (jsonrpc_arena_t *arena, size_t size)
+{
+	jsonrpc_arena_chunk_t	*chunk, *next;
+
+	jsonrpc_arena_reset(arena);
+	if (jsonrpc_arena_capacity(arena) <= size)
+		return;
+	for (chunk = arena->head->next ; chunk ; chunk = next)
+	{
+		next = chunk->next;
+		jsonrpc_arena_unchunk(chunk);
+	}
+	arena->head->next = NULL;
+}
+
+void    jsonrpc_arena_close (jsonrpc_arena_t *arena)
+{
+	jsonrpc_arena_chunk_t *chunk, *next;
+
+	for (chunk = arena->head ; chunk ; chunk = next)
+	{
+		next = chunk->next;
+		jsonrpc_arena_unchunk(chunk);
+	}
+	jsonrpc_free(arena);
+}
+
 void
 jsonrpc_set_alloc_funcs (
                          void * (* _malloc) (size_t n, void *userdata)
@@ -119,3 +521,12 @@ jsonrpc_set_alloc_funcs (
     s_memory.userdata = userdata;
 }
 
+const jsonrpc_allocator_t *
+jsonrpc_set_thread_allocator (const jsonrpc_allocator_t *allocator)
+{
+    const jsonrpc_allocator_t *previous = s_current;
+
+    s_current = allocator;
+    return previous;
+}
+
@@ -12,6 +12,8 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#include "jsonrpc.h"
+
 #ifdef  __cplusplus
 extern "C" {
 #endif
@@ -51,6 +53,49 @@ char *  jsonrpc_strdup (const char *str);
  */
 void    jsonrpc_vfree (void *mem, ...);
 
+/**
+ * allocator that jsonrpc_malloc() and the others use on the calling thread
+ */
+const jsonrpc_allocator_t *	jsonrpc_allocator_current (void);
+
+/**
+ * allocator keeping count of the bytes it hands out (in a header in front of each block),
+ * and refusing to hand out more than 'limit' at once.
+ * The huge page chunks of the arenas opened or grown while it is the allocator of the thread are counted too.
+ */
+typedef struct
+{
+	jsonrpc_allocator_t	allocator;	///< the counting allocator
+	jsonrpc_allocator_t	guard;		///< the same, reporting each call to 'hook' first
+	jsonrpc_allocator_t	base;		///< where the memory comes from
+	size_t				live;
+	size_t				peak;
+	size_t				limit;		///< 0: none
+	size_t				refused;	///< allocations refused for 'limit'
+	jsonrpc_alloc_hook_t	hook;	///< of 'guard' (NULL: its calls fail an assertion)
+	void				*userdata;	///< of 'hook'
+} jsonrpc_meter_t;
+
+/**
+ * set up 'meter' on top of 'base' (copied)
+ */
+void	jsonrpc_meter_init (jsonrpc_meter_t *meter, const jsonrpc_allocator_t *base);
+
+/**
+ * read a counter of 'meter' while other threads may be updating it
+ */
+size_t	jsonrpc_meter_read (const size_t *counter);
+
+/**
+ * bytes in the chunks of an arena
+ */
+size_t	jsonrpc_arena_capacity (jsonrpc_arena_t *arena);
+
+/**
+ * reset an arena, and give back the chunks after the first one if there are more than 'size' bytes in all
+ */
+void	jsonrpc_arena_trim (jsonrpc_arena_t *arena, size_t size);
+
 #ifdef  __cplusplus
 }
 #endif
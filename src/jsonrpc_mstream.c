@@ -7,31 +7,152 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include "jsonrpc_mstream.h"
+#include "jsonrpc_string.h"
 #include "jsonrpc_macro.h"
 #include "jsonrpc_memory.h"
 
 
 
+/**
+ * filled chunk of a chunked stream
+ */
+typedef struct
+{
+	char	*data;
+	size_t	length;
+	size_t	alloc;
+} jsonrpc_mstream_chunk_t;
+
 struct jsonrpc_mstream
 {
-	char	*stream;
+	char	*stream;	///< the chunk being written (the whole content unless chunked)
 	size_t	alloc;
 	size_t	length;
+
+	struct {
+		size_t	size;		///< size of a new chunk (0: contiguous, grown by realloc)
+		jsonrpc_mstream_chunk_t	*list;	///< filled chunks before 'stream', the first one is the head
+		size_t	count;
+		size_t	alloc;
+		size_t	length;		///< bytes in 'list'
+	} chunk;
+
+	struct {
+		jsonrpc_bool_t		attached;	///< 'stream' belongs to the caller
+		jsonrpc_mstream_grow_t	grow;
+		void				*ctx;
+	} external;
 };
 
-JSONRPC_PRIVATE size_t
-mstream_grow (jsonrpc_mstream_t *mstream)
+/**
+ * free the chunks after the head, and write to the head again
+ */
+JSONRPC_PRIVATE void
+mstream_drop_chunks (jsonrpc_mstream_t *mstream)
+{
+	size_t	i;
+
+	if (mstream->chunk.count == 0)
+		return;
+
+	for (i = 1 ; i < mstream->chunk.count ; i++)
+		jsonrpc_free(mstream->chunk.list[i].data);
+	jsonrpc_free(mstream->stream);
+	mstream->stream = mstream->chunk.list[0].data;
+	mstream->alloc  = mstream->chunk.list[0].alloc;
+	mstream->length = 0;
+	mstream->chunk.count  = 0;
+	mstream->chunk.length = 0;
+}
+
+/**
+ * leave the current chunk as it is, and go on in a new one of at least 'size' bytes
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t
+mstream_next_chunk (jsonrpc_mstream_t *mstream, size_t size)
+{
+	jsonrpc_mstream_chunk_t	*list;
+	char	*data;
+	size_t	alloc;
+
+	if (mstream->chunk.count == mstream->chunk.alloc)
+	{
+		alloc = mstream->chunk.alloc ? mstream->chunk.alloc * 2 : 8;
+		list  = (jsonrpc_mstream_chunk_t *)jsonrpc_realloc(mstream->chunk.list, alloc * sizeof(jsonrpc_mstream_chunk_t));
+		JSONRPC_THROW(list == NULL, return JSONRPC_FALSE);
+		mstream->chunk.list  = list;
+		mstream->chunk.alloc = alloc;
+	}
+	if (size < mstream->chunk.size)
+		size = mstream->chunk.size;
+	JSONRPC_THROW((data = (char *)jsonrpc_malloc(size)) == NULL, return JSONRPC_FALSE);
+
+	list = mstream->chunk.list + mstream->chunk.count++;
+	list->data   = mstream->stream;
+	list->length = mstream->length;
+	list->alloc  = mstream->alloc;
+	mstream->chunk.length += mstream->length;
+
+	mstream->stream = data;
+	mstream->alloc  = size;
+	mstream->length = 0;
+	mstream->stream[0] = '\0';
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t
+mstream_grow (jsonrpc_mstream_t *mstream, size_t length)
 {
-	void *grown;
+	void	*grown;
+	size_t	alloc;
+
+	for (alloc = (mstream->alloc < 64) ? 128 : mstream->alloc * 2 ; alloc - mstream->length <= length ; alloc *= 2)
+		;
+
+	if (mstream->external.attached)
+	{
+		if (mstream->external.grow)
+			grown = mstream->external.grow(mstream->external.ctx, mstream->stream, alloc);
+		else
+			grown = NULL;
 
-	grown = jsonrpc_realloc(mstream->stream, mstream->alloc * 2);
-	JSONRPC_THROW(grown == NULL, return 0);
+		if (grown == NULL)	// carry on in memory of our own
+		{
+			grown = jsonrpc_malloc(alloc);
+			JSONRPC_THROW(grown == NULL, return JSONRPC_FALSE);
+			memcpy(grown, mstream->stream, mstream->length);
+			mstream->external.attached = JSONRPC_FALSE;
+		}
+	}
+	else
+		grown = jsonrpc_realloc(mstream->stream, alloc);
+	JSONRPC_THROW(grown == NULL, return JSONRPC_FALSE);
 
 	mstream->stream = (char *)grown;
-	mstream->alloc  *= 2;
+	mstream->alloc  = alloc;
+	return JSONRPC_TRUE;
+}
 
-	return mstream->alloc - mstream->length - 1;	// return avaliable length
+/**
+ * make room for 'length' characters (and '\0') at the end of the current chunk
+ */
+JSONRPC_PRIVATE char *
+mstream_reserve (jsonrpc_mstream_t *mstream, size_t length)
+{
+	if (mstream->alloc - mstream->length <= length)
+	{
+		if (mstream->chunk.size > 0 && mstream->length > 0 && !mstream->external.attached)
+		{
+			JSONRPC_THROW(!mstream_next_chunk(mstream, length + 1), return NULL);
+		}
+		else
+		{
+			JSONRPC_THROW(!mstream_grow(mstream, length), return NULL);
+		}
+	}
+	return mstream->stream + mstream->length;
 }
 
 jsonrpc_mstream_t *
@@ -48,6 +169,7 @@ jsonrpc_mstream_open (void)
 			jsonrpc_free(mstream);
 			return NULL;
 		});
+		mstream->stream[0] = '\0';
 	}
 	return mstream;
 }
@@ -55,7 +177,58 @@ jsonrpc_mstream_open (void)
 void
 jsonrpc_mstream_close (jsonrpc_mstream_t *mstream)
 {
-	jsonrpc_vfree(mstream->stream, mstream, NULL);
+	mstream_drop_chunks(mstream);
+	if (mstream->chunk.list)
+		jsonrpc_free(mstream->chunk.list);
+	if (!mstream->external.attached && mstream->stream)
+		jsonrpc_free(mstream->stream);
+	jsonrpc_free(mstream);
+}
+
+void
+jsonrpc_mstream_set_chunk (jsonrpc_mstream_t *mstream, size_t size)
+{
+	mstream->chunk.size = size;
+}
+
+void
+jsonrpc_mstream_attach (jsonrpc_mstream_t *mstream, char *buf, size_t size, jsonrpc_mstream_grow_t grow, void *ctx)
+{
+	mstream_drop_chunks(mstream);
+	if (!mstream->external.attached && mstream->stream)
+		jsonrpc_free(mstream->stream);
+
+	mstream->stream = buf;
+	mstream->alloc  = buf ? size : 0;
+	mstream->length = 0;
+	mstream->external.attached = JSONRPC_TRUE;
+	mstream->external.grow     = grow;
+	mstream->external.ctx      = ctx;
+	if (mstream->alloc > 0)
+		mstream->stream[0] = '\0';
+}
+
+size_t
+jsonrpc_mstream_capacity (jsonrpc_mstream_t *mstream)
+{
+	size_t	i, alloc = mstream->alloc;
+
+	for (i = 0 ; i < mstream->chunk.count ; i++)
+		alloc += mstream->chunk.list[i].alloc;
+	return alloc;
+}
+
+char *
+jsonrpc_mstream_reserve (jsonrpc_mstream_t *mstream, size_t length)
+{
+	return mstream_reserve(mstream, length);
+}
+
+void
+jsonrpc_mstream_commit (jsonrpc_mstream_t *mstream, size_t length)
+{
+	mstream->length += length;
+	mstream->stream[mstream->length] = '\0';
 }
 
 int
@@ -65,27 +238,25 @@ jsonrpc_mstream_vprint (jsonrpc_mstream_t *mstream, const char *fmt, va_list ap)
 	size_t	length;
 	int		written;
 	va_list	va;
-	int		retry = 10;
 
-	if (mstream->alloc - mstream->length <= 1)
-	{
-		JSONRPC_THROW(mstream_grow(mstream) == 0, return -1);
-	}
+	// format into what is left; if it does not fit, the exact length is known for the second (and last) try
+	va_copy(va, ap);
+	stream  = mstream->stream + mstream->length;
+	length  = mstream->alloc - mstream->length;
+	written = vsnprintf(length ? stream : NULL, length, fmt, va);
+	va_end(va);
+	JSONRPC_THROW(written < 0, return -1);
 
-	while (retry--)
+	if ((size_t)written >= length)
 	{
+		JSONRPC_THROW((stream = mstream_reserve(mstream, (size_t)written)) == NULL, return -1);
 		va_copy(va, ap);
-		stream  = mstream->stream + mstream->length;
-		length  = mstream->alloc - mstream->length - 1/*for NULL*/;
-		written = vsnprintf(stream, length, fmt, va);
-		if (0 <= written && written < (int)length)
-		{
-			mstream->length += (size_t)written;
-			return written;
-		}
-		JSONRPC_THROW(mstream_grow(mstream) == 0, return -1);
+		written = vsnprintf(stream, (size_t)written + 1, fmt, va);
+		va_end(va);
+		JSONRPC_THROW(written < 0, return -1);
 	}
-	return -1;
+	mstream->length += (size_t)written;
+	return written;
 }
 
 int
@@ -101,21 +272,135 @@ jsonrpc_mstream_print (jsonrpc_mstream_t *mstream, const char *fmt, ...)
 	return ret;
 }
 
+int
+jsonrpc_mstream_write (jsonrpc_mstream_t *mstream, const char *data, size_t length)
+{
+	size_t	room, total = length;
+	char	*stream;
+
+	if (mstream->chunk.size > 0 && !mstream->external.attached && mstream->alloc > mstream->length + 1)
+	{
+		// fill up the current chunk before moving on to the next one
+		room = mstream->alloc - mstream->length - 1;
+		if (room < length)
+		{
+			memcpy(mstream->stream + mstream->length, data, room);
+			mstream->length += room;
+			data   += room;
+			length -= room;
+		}
+	}
+	JSONRPC_THROW((stream = mstream_reserve(mstream, length)) == NULL, return -1);
+	memcpy(stream, data, length);
+	mstream->length += length;
+	mstream->stream[mstream->length] = '\0';
+	return (int)total;
+}
+
+int
+jsonrpc_mstream_write_string (jsonrpc_mstream_t *mstream, const char *str, size_t length)
+{
+	static const char	hex[] = "0123456789abcdef";
+	size_t	start = jsonrpc_mstream_length(mstream), run;
+	char	esc[6] = { '\\', 'u', '0', '0' };
+	unsigned char	c;
+
+	JSONRPC_THROW(jsonrpc_mstream_write(mstream, "\"", 1) < 0, return -1);
+	for (;;)
+	{
+		// clean runs are copied as they are
+		run = jsonrpc_string_escape_span(str, length);
+		JSONRPC_THROW(jsonrpc_mstream_write(mstream, str, run) < 0, return -1);
+		if (run == length)
+			break;
+
+		c = (unsigned char)str[run];
+		switch (c)
+		{
+		case '"':  esc[1] = '"';  break;
+		case '\\': esc[1] = '\\'; break;
+		case '\b': esc[1] = 'b';  break;
+		case '\f': esc[1] = 'f';  break;
+		case '\n': esc[1] = 'n';  break;
+		case '\r': esc[1] = 'r';  break;
+		case '\t': esc[1] = 't';  break;
+		default:   esc[1] = 'u';  break;
+		}
+		esc[4] = hex[c >> 4];
+		esc[5] = hex[c & 0xf];
+		JSONRPC_THROW(jsonrpc_mstream_write(mstream, esc, (esc[1] == 'u') ? 6 : 2) < 0, return -1);
+
+		str    += run + 1;
+		length -= run + 1;
+	}
+	JSONRPC_THROW(jsonrpc_mstream_write(mstream, "\"", 1) < 0, return -1);
+	return (int)(jsonrpc_mstream_length(mstream) - start);
+}
+
 size_t
 jsonrpc_mstream_length (jsonrpc_mstream_t *mstream)
 {
-	return mstream->length;
+	return mstream->chunk.length + mstream->length;
 }
 
 void
 jsonrpc_mstream_rewind (jsonrpc_mstream_t *mstream)
 {
+	mstream_drop_chunks(mstream);
 	mstream->length = 0;
+	if (mstream->alloc > 0)
+		mstream->stream[0] = '\0';
+}
+
+void
+jsonrpc_mstream_trim (jsonrpc_mstream_t *mstream, size_t size)
+{
+	char	*shrunk;
+
+	jsonrpc_mstream_rewind(mstream);
+	if (size < 128)
+		size = 128;
+	if (mstream->external.attached || mstream->alloc <= size)
+		return;
+
+	if ((shrunk = (char *)jsonrpc_realloc(mstream->stream, size)) != NULL)
+	{
+		mstream->stream = shrunk;
+		mstream->alloc  = size;
+	}
 }
 
 const char *
 jsonrpc_mstream_getbuf (jsonrpc_mstream_t *mstream)
 {
+	jsonrpc_mstream_chunk_t	*head;
+	char	*flat;
+	size_t	i, alloc, length;
+
+	if (mstream->chunk.count > 0)
+	{
+		// flatten into a new head big enough for the whole content, kept for the next ones
+		head   = mstream->chunk.list;
+		length = jsonrpc_mstream_length(mstream);
+		for (alloc = head->alloc ; alloc <= length ; alloc *= 2)
+			;
+		JSONRPC_THROW((flat = (char *)jsonrpc_malloc(alloc)) == NULL, return NULL);
+
+		for (i = 0, length = 0 ; i < mstream->chunk.count ; i++)
+		{
+			memcpy(flat + length, head[i].data, head[i].length);
+			length += head[i].length;
+		}
+		memcpy(flat + length, mstream->stream, mstream->length);
+		length += mstream->length;
+		flat[length] = '\0';
+
+		mstream_drop_chunks(mstream);
+		jsonrpc_free(mstream->stream);
+		mstream->stream = flat;
+		mstream->alloc  = alloc;
+		mstream->length = length;
+	}
 	return mstream->stream;
 }
 
@@ -18,6 +18,13 @@ extern "C" {
 
 typedef struct jsonrpc_mstream	jsonrpc_mstream_t;
 
+/**
+ * Grow a buffer given to jsonrpc_mstream_attach() to 'size' bytes, keeping its content (like realloc).
+ *
+ * @return the grown buffer, or NULL to let the stream carry on in memory of its own
+ */
+typedef char * (* jsonrpc_mstream_grow_t) (void *ctx, char *buf, size_t size);
+
 /**
  * Open the memory stream.
  *
@@ -35,7 +42,64 @@ void
 jsonrpc_mstream_close (jsonrpc_mstream_t *mstream);
 
 /**
- * Formatted input to memory stream
+ * Switch the stream to chunks of 'size' bytes (0: one contiguous buffer, the default).
+ * A chunked stream appends a new chunk when the current one is full instead of
+ * moving its content to a bigger buffer; jsonrpc_mstream_getbuf() joins them
+ * on demand into one buffer, which the stream then keeps for the next contents.
+ * A buffer given to jsonrpc_mstream_attach() is never chunked.
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param size	size of a chunk
+ */
+void
+jsonrpc_mstream_set_chunk (jsonrpc_mstream_t *mstream, size_t size);
+
+/**
+ * Write to a buffer of the caller from the beginning, instead of the stream's own memory.
+ * When it is full, the stream asks 'grow' for more (if not NULL) or moves on to memory
+ * of its own; jsonrpc_mstream_getbuf() tells where the content is.
+ * The buffer stays the caller's: it is never freed by the stream.
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param buf	buffer of 'size' bytes (may be NULL if 'size' is 0)
+ * @param grow	(optional) grows the buffer
+ * @param ctx	context of 'grow'
+ */
+void
+jsonrpc_mstream_attach (jsonrpc_mstream_t *mstream, char *buf, size_t size, jsonrpc_mstream_grow_t grow, void *ctx);
+
+/**
+ * The number of bytes of the memory behind the stream
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @return The size of the buffer
+ */
+size_t
+jsonrpc_mstream_capacity (jsonrpc_mstream_t *mstream);
+
+/**
+ * Get room for 'length' characters (and '\0') at the end of the stream, to write
+ * them in place. The characters are added by jsonrpc_mstream_commit().
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param length	number of characters
+ * @return contiguous room of 'length + 1' bytes (if error, return NULL)
+ */
+char *
+jsonrpc_mstream_reserve (jsonrpc_mstream_t *mstream, size_t length);
+
+/**
+ * Add 'length' characters written in the room given by jsonrpc_mstream_reserve()
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param length	number of characters (up to the reserved length)
+ */
+void
+jsonrpc_mstream_commit (jsonrpc_mstream_t *mstream, size_t length);
+
+/**
+ * Formatted input to memory stream. The text is formatted at most twice:
+ * the second time in room of the exact length, if it did not fit.
  *
  * @param mstream	instance of 'jsonrpc_mstream_t'
  * @param fmt	format (same as printf's)
@@ -56,6 +120,29 @@ jsonrpc_mstream_vprint (jsonrpc_mstream_t *mstream, const char *fmt, va_list ap)
 int
 jsonrpc_mstream_print (jsonrpc_mstream_t *mstream, const char *fmt, ...);
 
+/**
+ * Append 'length' bytes of 'data' as they are (no formatting)
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param data	bytes to append
+ * @param length	number of bytes
+ * @return The number of written characters. (if error, return -1)
+ */
+int
+jsonrpc_mstream_write (jsonrpc_mstream_t *mstream, const char *data, size_t length);
+
+/**
+ * Append 'length' bytes of 'str' as a JSON string: quoted, with quotes,
+ * backslashes and control characters escaped
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param str	UTF-8 bytes
+ * @param length	number of bytes
+ * @return The number of written characters. (if error, return -1)
+ */
+int
+jsonrpc_mstream_write_string (jsonrpc_mstream_t *mstream, const char *str, size_t length);
+
 /**
  * The number of written characters
  *
@@ -74,10 +161,20 @@ void
 jsonrpc_mstream_rewind (jsonrpc_mstream_t *mstream);
 
 /**
- * Get memory stream buffer
+ * Rewind the stream, and shrink its memory to 'size' bytes if it has more.
+ * (an attached buffer is left as it is)
+ *
+ * @param mstream	instance of 'jsonrpc_mstream_t'
+ * @param size	bytes to keep
+ */
+void
+jsonrpc_mstream_trim (jsonrpc_mstream_t *mstream, size_t size);
+
+/**
+ * Get memory stream buffer (the chunks of a chunked stream are joined first)
  *
  * @param mstream	instance of 'jsonrpc_mstream_t'
- * @return	'\0' terminated string
+ * @return	'\0' terminated string (if error, return NULL)
  */
 const char *
 jsonrpc_mstream_getbuf (jsonrpc_mstream_t *mstream);
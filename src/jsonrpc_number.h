@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#ifndef jsonrpc_jsonrpc_number_h
+#define jsonrpc_jsonrpc_number_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Parse a JSON number at 'str'.
+ * A number without fraction and exponent that fits in 64 bits becomes JSONRPC_TYPE_INTEGER,
+ * any other number JSONRPC_TYPE_NUMBER.
+ *
+ * @return pointer just past the number, or NULL if 'str' does not start with a valid number
+ */
+const char *	jsonrpc_number_parse (const char *str, jsonrpc_json_t *value);
+
+#define	JSONRPC_NUMBER_BUF_LEN		32	///< enough for any number printed below
+
+/**
+ * Print 'value' in decimal to 'buf' (at least JSONRPC_NUMBER_BUF_LEN bytes, not '\0' terminated).
+ *
+ * @return number of characters
+ */
+size_t	jsonrpc_number_print_integer (char *buf, int64_t value);
+
+/**
+ * Print 'value' as a JSON number to 'buf' (at least JSONRPC_NUMBER_BUF_LEN bytes, not '\0' terminated),
+ * with enough digits to read back the same double. NaN and infinities, which JSON can not express, print as null.
+ *
+ * @return number of characters
+ */
+size_t	jsonrpc_number_print_double (char *buf, double value);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#include "jsonrpc_plugin_insitu.h"
+
+#include "jsonrpc_macro.h"
+#include "jsonrpc_memory.h"
+#include "jsonrpc_string.h"
+#include "jsonrpc_number.h"
+
+
+#define	JSONRPC_INSITU_MAX_DEPTH	512
+
+typedef struct jsonrpc_insitu_value	jsonrpc_insitu_value_t;
+
+struct jsonrpc_insitu_value
+{
+	jsonrpc_type_t			type;
+	const char				*key;		///< member name (if parent is an object)
+	size_t					length;		///< number of children (array, object) or bytes (string)
+	jsonrpc_insitu_value_t	*next;		///< next sibling (while parsing)
+	union
+	{
+		double					number;
+		int64_t					integer;
+		jsonrpc_bool_t			boolean;
+		char					*string;
+		jsonrpc_insitu_value_t	**items;	///< children (array, object)
+	} u;
+};
+
+typedef struct
+{
+	jsonrpc_insitu_value_t	root;	///< must be the first member (handle of the document)
+	jsonrpc_arena_t			*arena;	///< arena owned by the document (NULL if owned by the server)
+} jsonrpc_insitu_doc_t;
+
+typedef struct
+{
+	char			*p;
+	jsonrpc_arena_t	*arena;
+	int				depth;
+} jsonrpc_insitu_parser_t;
+
+
+JSONRPC_PRIVATE char * skip_space (char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+		p++;
+	return p;
+}
+
+/**
+ * unescape the string at 'ps->p' (opening quote) in place.
+ */
+JSONRPC_PRIVATE char * parse_string (jsonrpc_insitu_parser_t *ps, size_t *length)
+{
+	char	*str = ps->p + 1, *end;
+
+	JSONRPC_THROW((end = jsonrpc_string_unescape(str, length)) == NULL, return NULL);
+	ps->p = end;
+	return str;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t parse_number (jsonrpc_insitu_parser_t *ps, jsonrpc_insitu_value_t *value)
+{
+	jsonrpc_json_t	number;
+	const char		*end;
+
+	JSONRPC_THROW((end = jsonrpc_number_parse(ps->p, &number)) == NULL, return JSONRPC_FALSE);
+	value->type = number.type;
+	if (number.type == JSONRPC_TYPE_INTEGER)
+		value->u.integer = number.u.integer;
+	else
+		value->u.number = number.u.number;
+	ps->p += end - ps->p;
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_insitu_value_t * parse_value (jsonrpc_insitu_parser_t *ps, const char *key);
+
+JSONRPC_PRIVATE jsonrpc_bool_t parse_container (jsonrpc_insitu_parser_t *ps, jsonrpc_insitu_value_t *value, char close)
+{
+	jsonrpc_insitu_value_t	*first, *last, *child;
+	const char	*key = NULL;
+	size_t		i;
+
+	JSONRPC_THROW(++ps->depth > JSONRPC_INSITU_MAX_DEPTH, return JSONRPC_FALSE);
+
+	first = last = NULL;
+	ps->p = skip_space(ps->p + 1);
+	if (*ps->p == close)
+		ps->p++;
+	else for (;;)
+	{
+		if (close == '}')
+		{
+			ps->p = skip_space(ps->p);
+			JSONRPC_THROW(*ps->p != '"' || (key = parse_string(ps, NULL)) == NULL, return JSONRPC_FALSE);
+			ps->p = skip_space(ps->p);
+			JSONRPC_THROW(*ps->p != ':', return JSONRPC_FALSE);
+			ps->p++;
+		}
+		JSONRPC_THROW((child = parse_value(ps, key)) == NULL, return JSONRPC_FALSE);
+		if (last)
+			last->next = child;
+		else
+			first = child;
+		last = child;
+		value->length++;
+
+		ps->p = skip_space(ps->p);
+		if (*ps->p == ',')
+		{
+			ps->p++;
+			continue;
+		}
+		JSONRPC_THROW(*ps->p != close, return JSONRPC_FALSE);
+		ps->p++;
+		break;
+	}
+
+	if (value->length > 0)
+	{
+		value->u.items = (jsonrpc_insitu_value_t **)jsonrpc_arena_alloc(ps->arena, value->length * sizeof(jsonrpc_insitu_value_t *));
+		JSONRPC_THROW(value->u.items == NULL, return JSONRPC_FALSE);
+		for (i = 0, child = first ; child ; child = child->next)
+			value->u.items[i++] = child;
+	}
+	ps->depth--;
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_insitu_value_t * parse_value (jsonrpc_insitu_parser_t *ps, const char *key)
+{
+	jsonrpc_insitu_value_t	*value;
+
+	value = (jsonrpc_insitu_value_t *)jsonrpc_arena_alloc(ps->arena, sizeof(jsonrpc_insitu_value_t));
+	JSONRPC_THROW(value == NULL, return NULL);
+	memset(value, 0, sizeof(jsonrpc_insitu_value_t));
+	value->key = key;
+
+	ps->p = skip_space(ps->p);
+	switch (*ps->p)
+	{
+	case '{':
+		value->type = JSONRPC_TYPE_OBJECT;
+		JSONRPC_THROW(!parse_container(ps, value, '}'), return NULL);
+		break;
+
+	case '[':
+		value->type = JSONRPC_TYPE_ARRAY;
+		JSONRPC_THROW(!parse_container(ps, value, ']'), return NULL);
+		break;
+
+	case '"':
+		value->type = JSONRPC_TYPE_STRING;
+		JSONRPC_THROW((value->u.string = parse_string(ps, &value->length)) == NULL, return NULL);
+		break;
+
+	case 't':
+		JSONRPC_THROW(strncmp(ps->p, "true", 4) != 0, return NULL);
+		value->type      = JSONRPC_TYPE_BOOLEAN;
+		value->u.boolean = JSONRPC_TRUE;
+		ps->p += 4;
+		break;
+
+	case 'f':
+		JSONRPC_THROW(strncmp(ps->p, "false", 5) != 0, return NULL);
+		value->type      = JSONRPC_TYPE_BOOLEAN;
+		value->u.boolean = JSONRPC_FALSE;
+		ps->p += 5;
+		break;
+
+	case 'n':
+		JSONRPC_THROW(strncmp(ps->p, "null", 4) != 0, return NULL);
+		value->type = JSONRPC_TYPE_NULL;
+		ps->p += 4;
+		break;
+
+	default:
+		JSONRPC_THROW(!parse_number(ps, value), return NULL);
+		break;
+	}
+	return value;
+}
+
+
+static jsonrpc_handle_t	jsonrpc_insitu_parse_insitu (char *json, size_t length, jsonrpc_arena_t *arena)
+{
+	jsonrpc_insitu_parser_t	ps;
+	jsonrpc_insitu_doc_t	*doc;
+	jsonrpc_insitu_value_t	*root;
+
+	doc = (jsonrpc_insitu_doc_t *)jsonrpc_arena_alloc(arena, sizeof(jsonrpc_insitu_doc_t));
+	JSONRPC_THROW(doc == NULL, return NULL);
+
+	ps.p     = json;
+	ps.arena = arena;
+	ps.depth = 0;
+	JSONRPC_THROW((root = parse_value(&ps, NULL)) == NULL, return NULL);
+	JSONRPC_THROW(skip_space(ps.p) != json + length, return NULL);	// trailing garbage
+
+	memcpy(&doc->root, root, sizeof(jsonrpc_insitu_value_t));	// nobody refers to the root value
+	doc->arena = NULL;
+	return (jsonrpc_handle_t)doc;
+}
+
+static jsonrpc_handle_t	jsonrpc_insitu_parse (const char *json)
+{
+	jsonrpc_arena_t			*arena;
+	jsonrpc_insitu_doc_t	*doc;
+	char	*dup;
+	size_t	length;
+
+	length = strlen(json);
+	arena  = jsonrpc_arena_open(length + 1 + 1024, 0);
+	JSONRPC_THROW(arena == NULL, return NULL);
+
+	doc = NULL;
+	dup = (char *)jsonrpc_arena_alloc(arena, length + 1);
+	if (dup)
+	{
+		memcpy(dup, json, length + 1);
+		doc = (jsonrpc_insitu_doc_t *)jsonrpc_insitu_parse_insitu(dup, length, arena);
+	}
+	if (doc == NULL)
+	{
+		jsonrpc_arena_close(arena);
+		return NULL;
+	}
+	doc->arena = arena;
+	return (jsonrpc_handle_t)doc;
+}
+
+static void				jsonrpc_insitu_release (jsonrpc_handle_t json)
+{
+	jsonrpc_insitu_doc_t	*doc = (jsonrpc_insitu_doc_t *)json;
+
+	if (doc && doc->arena)
+		jsonrpc_arena_close(doc->arena);
+}
+
+static jsonrpc_handle_t	jsonrpc_insitu_get (jsonrpc_handle_t json, const char *key)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+	size_t	i;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return NULL;
+
+	for (i = 0 ; i < v->length ; i++)
+	{
+		if (strcmp(v->u.items[i]->key, key) == 0)
+			return (jsonrpc_handle_t)v->u.items[i];
+	}
+	return NULL;
+}
+
+static void				jsonrpc_insitu_get_members (jsonrpc_handle_t json, const char * const *keys, size_t n, jsonrpc_handle_t *values)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+	size_t	i, k;
+
+	for (k = 0 ; k < n ; k++)
+		values[k] = NULL;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return;
+
+	for (i = 0 ; i < v->length ; i++)
+	{
+		for (k = 0 ; k < n ; k++)
+		{
+			if (values[k] == NULL && strcmp(v->u.items[i]->key, keys[k]) == 0)
+			{
+				values[k] = (jsonrpc_handle_t)v->u.items[i];
+				break;
+			}
+		}
+	}
+}
+
+static jsonrpc_handle_t	jsonrpc_insitu_get_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+
+	if ((v->type == JSONRPC_TYPE_OBJECT || v->type == JSONRPC_TYPE_ARRAY) && index < v->length)
+		return (jsonrpc_handle_t)v->u.items[index];
+	return NULL;
+}
+
+static const char *		jsonrpc_insitu_get_key_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT && index < v->length)
+		return v->u.items[index]->key;
+	return NULL;
+}
+
+static jsonrpc_bool_t	jsonrpc_insitu_valueof (jsonrpc_handle_t json, jsonrpc_json_t *value)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+
+	value->type   = v->type;
+	value->length = 0;
+	switch (v->type)
+	{
+	case JSONRPC_TYPE_NUMBER:
+		value->u.number = v->u.number;
+		break;
+
+	case JSONRPC_TYPE_INTEGER:
+		value->u.integer = v->u.integer;
+		break;
+
+	case JSONRPC_TYPE_BOOLEAN:
+		value->u.boolean = v->u.boolean;
+		break;
+
+	case JSONRPC_TYPE_STRING:
+		value->u.string = v->u.string;
+		value->length   = v->length;
+		break;
+
+	case JSONRPC_TYPE_OBJECT:
+	case JSONRPC_TYPE_ARRAY:
+		value->u.object = json;
+		break;
+
+	case JSONRPC_TYPE_NULL:
+		break;
+
+	default:
+		return JSONRPC_FALSE;
+	}
+	return JSONRPC_TRUE;
+}
+
+static size_t			jsonrpc_insitu_length (jsonrpc_handle_t json)
+{
+	jsonrpc_insitu_value_t	*v = (jsonrpc_insitu_value_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT || v->type == JSONRPC_TYPE_ARRAY)
+		return v->length;
+	return 0;
+}
+
+
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_insitu (void)
+{
+	static const jsonrpc_json_plugin_t plugin_insitu = {
+		jsonrpc_insitu_parse,
+		jsonrpc_insitu_release,
+		jsonrpc_insitu_get,
+		jsonrpc_insitu_get_at,
+		jsonrpc_insitu_get_key_at,
+		jsonrpc_insitu_valueof,
+		jsonrpc_insitu_length,
+		jsonrpc_insitu_get_members,
+		jsonrpc_insitu_parse_insitu,
+		JSONRPC_TRUE	// strings are validated as they are scanned
+	};
+	return &plugin_insitu;
+}
+
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef jsonrpc_jsonrpc_plugin_insitu_h
+#define jsonrpc_jsonrpc_plugin_insitu_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * built-in json plugin.
+ * parses in place: strings are unescaped inside the request buffer and
+ * values are allocated from the server's arena, so parsing needs no allocation.
+ */
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_insitu (void);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
+
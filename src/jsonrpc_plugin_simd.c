@@ -0,0 +1,758 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "jsonrpc_plugin_simd.h"
+
+#include "jsonrpc_macro.h"
+#include "jsonrpc_memory.h"
+#include "jsonrpc_string.h"
+#include "jsonrpc_number.h"
+#include "jsonrpc_utf8.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(JSONRPC_SIMD_SCALAR)
+#define	JSONRPC_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+#define	JSONRPC_SIMD_BLOCK			64
+#define	JSONRPC_SIMD_MAX_DEPTH		512
+#define	JSONRPC_SIMD_SMALL_INDEX	1024	///< index entries kept on the stack (small documents need no allocation)
+
+#if defined(__GNUC__)
+#define	JSONRPC_SIMD_CTZ(x)			__builtin_ctzll(x)
+#define	JSONRPC_SIMD_POPCOUNT(x)	__builtin_popcountll(x)
+#else
+#define	JSONRPC_SIMD_CTZ(x)			ctz64(x)
+#define	JSONRPC_SIMD_POPCOUNT(x)	popcount64(x)
+#endif
+
+/**
+ * character classes of a 64 bytes block, one bit per byte
+ */
+typedef struct
+{
+	uint64_t	quote;		///< "
+	uint64_t	backslash;	///< \ .
+	uint64_t	op;			///< { } [ ] : ,
+	uint64_t	open;		///< { [
+	uint64_t	space;		///< ' ' \t \n \r
+	uint64_t	control;	///< < 0x20
+	uint64_t	high;		///< >= 0x80
+} jsonrpc_simd_block_t;
+
+/**
+ * structural index (offsets of the tokens)
+ */
+typedef struct
+{
+	uint32_t	*offset;
+	size_t		size;
+	size_t		capacity;
+	size_t		values;		///< number of values and keys (tape nodes)
+	jsonrpc_bool_t	ascii;	///< no byte >= 0x80: no UTF-8 to validate
+	jsonrpc_arena_t	*arena;	///< memory of a bigger index (NULL: the heap)
+	uint32_t	small[JSONRPC_SIMD_SMALL_INDEX];
+} jsonrpc_simd_index_t;
+
+typedef void (* jsonrpc_simd_classify_t) (const unsigned char *in, jsonrpc_simd_block_t *block);
+
+typedef struct jsonrpc_simd_node	jsonrpc_simd_node_t;
+
+/**
+ * tape entry.
+ * the children of a container follow it on the tape (an object member is a key node then a value node)
+ */
+struct jsonrpc_simd_node
+{
+	jsonrpc_type_t	type;
+	uint32_t		skip;	///< number of nodes of the value (itself and its children)
+	union
+	{
+		double			number;
+		int64_t			integer;
+		jsonrpc_bool_t	boolean;
+		struct
+		{
+			char		*chars;
+			uint32_t	length;	///< number of bytes
+		} string;
+		struct
+		{
+			uint32_t	length;	///< number of children
+			uint32_t	cursor;	///< child index of 'offset' (last 'get_at')
+			uint32_t	offset;	///< node offset of the child 'cursor'
+		} container;
+	} u;
+};
+
+typedef struct
+{
+	jsonrpc_bool_t		owned;		///< allocated by 'parse' (otherwise from the server's arena)
+	jsonrpc_simd_node_t	tape[1];	///< tape[0] is the root (handle of the document)
+} jsonrpc_simd_doc_t;
+
+#define	JSONRPC_SIMD_DOC(root)	((jsonrpc_simd_doc_t *)((char *)(root) - offsetof(jsonrpc_simd_doc_t, tape)))
+
+
+#if !defined(__GNUC__)
+JSONRPC_PRIVATE int ctz64 (uint64_t x)
+{
+	int	n = 0;
+
+	while (!(x & 1))
+	{
+		x >>= 1;
+		n++;
+	}
+	return n;
+}
+
+JSONRPC_PRIVATE int popcount64 (uint64_t x)
+{
+	int	n;
+
+	for (n = 0 ; x ; n++)
+		x &= x - 1;
+	return n;
+}
+#endif
+
+#ifndef JSONRPC_SIMD_X86
+JSONRPC_PRIVATE void classify_scalar (const unsigned char *in, jsonrpc_simd_block_t *block)
+{
+	uint64_t	bit;
+	int			i;
+
+	memset(block, 0, sizeof(jsonrpc_simd_block_t));
+	for (i = 0 ; i < JSONRPC_SIMD_BLOCK ; i++)
+	{
+		bit = (uint64_t)1 << i;
+		switch (in[i])
+		{
+		case '"':  block->quote     |= bit; break;
+		case '\\': block->backslash |= bit; break;
+		case '{': case '[':
+			block->op   |= bit;
+			block->open |= bit;
+			break;
+		case '}': case ']': case ':': case ',':
+			block->op |= bit;
+			break;
+		case ' ':
+			block->space |= bit;
+			break;
+		case '\t': case '\n': case '\r':
+			block->space |= bit;
+			block->control |= bit;
+			break;
+		default:
+			if (in[i] < 0x20)
+				block->control |= bit;
+			else if (in[i] >= 0x80)
+				block->high |= bit;
+			break;
+		}
+	}
+}
+#else
+JSONRPC_PRIVATE void classify_sse2 (const unsigned char *in, jsonrpc_simd_block_t *block)
+{
+	const __m128i	quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+	const __m128i	lcurly = _mm_set1_epi8('{'), rcurly = _mm_set1_epi8('}');
+	const __m128i	colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+	const __m128i	space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+	const __m128i	lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+	const __m128i	case_bit = _mm_set1_epi8(0x20), control = _mm_set1_epi8(0x1F);
+	__m128i		x, folded, open, op, ws;
+	uint64_t	shift;
+	int			i;
+
+	memset(block, 0, sizeof(jsonrpc_simd_block_t));
+	for (i = 0 ; i < JSONRPC_SIMD_BLOCK ; i += 16)
+	{
+		x      = _mm_loadu_si128((const __m128i *)(in + i));
+		folded = _mm_or_si128(x, case_bit);	// '[' -> '{', ']' -> '}'
+		open   = _mm_cmpeq_epi8(folded, lcurly);
+		op     = _mm_or_si128(
+					  _mm_or_si128(open, _mm_cmpeq_epi8(folded, rcurly))
+					, _mm_or_si128(_mm_cmpeq_epi8(x, colon), _mm_cmpeq_epi8(x, comma))
+				);
+		ws     = _mm_or_si128(
+					  _mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab))
+					, _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr))
+				);
+
+		shift = (uint64_t)i;
+		block->quote     |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote)) << shift;
+		block->backslash |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, backslash)) << shift;
+		block->op        |= (uint64_t)(uint32_t)_mm_movemask_epi8(op) << shift;
+		block->open      |= (uint64_t)(uint32_t)_mm_movemask_epi8(open) << shift;
+		block->space     |= (uint64_t)(uint32_t)_mm_movemask_epi8(ws) << shift;
+		block->control   |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, control), x)) << shift;
+		block->high      |= (uint64_t)(uint32_t)_mm_movemask_epi8(x) << shift;
+	}
+}
+
+__attribute__((target("avx2")))
+JSONRPC_PRIVATE void classify_avx2 (const unsigned char *in, jsonrpc_simd_block_t *block)
+{
+	const __m256i	quote = _mm256_set1_epi8('"'), backslash = _mm256_set1_epi8('\\');
+	const __m256i	lcurly = _mm256_set1_epi8('{'), rcurly = _mm256_set1_epi8('}');
+	const __m256i	colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+	const __m256i	space = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+	const __m256i	lf = _mm256_set1_epi8('\n'), cr = _mm256_set1_epi8('\r');
+	const __m256i	case_bit = _mm256_set1_epi8(0x20), control = _mm256_set1_epi8(0x1F);
+	__m256i		x, folded, open, op, ws;
+	uint64_t	shift;
+	int			i;
+
+	memset(block, 0, sizeof(jsonrpc_simd_block_t));
+	for (i = 0 ; i < JSONRPC_SIMD_BLOCK ; i += 32)
+	{
+		x      = _mm256_loadu_si256((const __m256i *)(in + i));
+		folded = _mm256_or_si256(x, case_bit);
+		open   = _mm256_cmpeq_epi8(folded, lcurly);
+		op     = _mm256_or_si256(
+					  _mm256_or_si256(open, _mm256_cmpeq_epi8(folded, rcurly))
+					, _mm256_or_si256(_mm256_cmpeq_epi8(x, colon), _mm256_cmpeq_epi8(x, comma))
+				);
+		ws     = _mm256_or_si256(
+					  _mm256_or_si256(_mm256_cmpeq_epi8(x, space), _mm256_cmpeq_epi8(x, tab))
+					, _mm256_or_si256(_mm256_cmpeq_epi8(x, lf), _mm256_cmpeq_epi8(x, cr))
+				);
+
+		shift = (uint64_t)i;
+		block->quote     |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote)) << shift;
+		block->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, backslash)) << shift;
+		block->op        |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+		block->open      |= (uint64_t)(uint32_t)_mm256_movemask_epi8(open) << shift;
+		block->space     |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+		block->control   |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x, control), x)) << shift;
+		block->high      |= (uint64_t)(uint32_t)_mm256_movemask_epi8(x) << shift;
+	}
+}
+#endif
+
+JSONRPC_PRIVATE jsonrpc_simd_classify_t select_classify (void)
+{
+#ifdef JSONRPC_SIMD_X86
+	static jsonrpc_simd_classify_t	selected;	///< shared by all the threads: atomic accesses only
+	jsonrpc_simd_classify_t	classify;
+
+	if ((classify = __atomic_load_n(&selected, __ATOMIC_ACQUIRE)) == NULL)
+	{
+		__builtin_cpu_init();
+		classify = __builtin_cpu_supports("avx2") ? classify_avx2 : classify_sse2;
+		__atomic_store_n(&selected, classify, __ATOMIC_RELEASE);	// threads racing here all store the same one
+	}
+	return classify;
+#else
+	return classify_scalar;
+#endif
+}
+
+/**
+ * characters escaped by a backslash.
+ * 'carry' is set if the last byte of the block escapes the first byte of the next one.
+ */
+JSONRPC_PRIVATE uint64_t find_escaped (uint64_t backslash, uint64_t *carry)
+{
+	uint64_t	escaped = *carry;
+	int			i;
+
+	backslash &= ~escaped;
+	*carry = 0;
+	while (backslash)
+	{
+		i = JSONRPC_SIMD_CTZ(backslash);
+		if (i == JSONRPC_SIMD_BLOCK - 1)
+		{
+			*carry = 1;
+			break;
+		}
+		escaped   |= (uint64_t)2 << i;
+		backslash &= ~((uint64_t)3 << i);	// an escaped backslash escapes nothing
+	}
+	return escaped;
+}
+
+/**
+ * bit i = xor of bits 0..i (1 from an opening quote up to the closing quote)
+ */
+JSONRPC_PRIVATE uint64_t prefix_xor (uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t grow_index (jsonrpc_simd_index_t *index)
+{
+	size_t		capacity = index->capacity * 2;
+	uint32_t	*offset;
+
+	if (index->arena)	// the smaller ones are left to the request
+	{
+		offset = (uint32_t *)jsonrpc_arena_alloc(index->arena, capacity * sizeof(uint32_t));
+		JSONRPC_THROW(offset == NULL, return JSONRPC_FALSE);
+		memcpy(offset, index->offset, index->size * sizeof(uint32_t));
+	}
+	else if (index->offset == index->small)
+	{
+		offset = (uint32_t *)jsonrpc_malloc(capacity * sizeof(uint32_t));
+		JSONRPC_THROW(offset == NULL, return JSONRPC_FALSE);
+		memcpy(offset, index->small, index->size * sizeof(uint32_t));
+	}
+	else
+	{
+		offset = (uint32_t *)jsonrpc_realloc(index->offset, capacity * sizeof(uint32_t));
+		JSONRPC_THROW(offset == NULL, return JSONRPC_FALSE);
+	}
+	index->offset   = offset;
+	index->capacity = capacity;
+	return JSONRPC_TRUE;
+}
+
+/**
+ * stage 1: index the offsets of the structural characters, quotes and the first
+ * characters of the other tokens (numbers, literals), followed by 'length'.
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t build_index (const char *json, size_t length, jsonrpc_simd_index_t *index)
+{
+	jsonrpc_simd_classify_t	classify = select_classify();
+	jsonrpc_simd_block_t	block;
+	unsigned char	tail[JSONRPC_SIMD_BLOCK];
+	const unsigned char	*in;
+	uint64_t	escape = 0, in_string = 0, other_carry = 0, error = 0, high = 0;
+	uint64_t	quote, string, other, starts, bits;
+	uint32_t	*offset;
+	size_t		pos, n = 0, values = 0;
+
+	index->offset   = index->small;
+	index->capacity = JSONRPC_SIMD_SMALL_INDEX;
+	for (pos = 0 ; pos < length ; pos += JSONRPC_SIMD_BLOCK)
+	{
+		in = (const unsigned char *)json + pos;
+		if (length - pos < JSONRPC_SIMD_BLOCK)
+		{
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, in, length - pos);
+			in = tail;
+		}
+		classify(in, &block);
+
+		quote     = block.quote & ~find_escaped(block.backslash, &escape);
+		string    = prefix_xor(quote) ^ in_string;
+		in_string = (uint64_t)0 - (string >> 63);
+		error    |= block.control & string;
+		high     |= block.high;
+
+		other       = ~(block.op | block.space | quote | string);
+		starts      = other & ~((other << 1) | other_carry);
+		bits        = (block.op & ~string) | quote | starts;
+		values     += JSONRPC_SIMD_POPCOUNT((block.open & ~string) | (quote & string) | starts);
+		other_carry = other >> 63;
+
+		if (n + JSONRPC_SIMD_BLOCK + 1 > index->capacity)
+		{
+			index->size = n;
+			JSONRPC_THROW(!grow_index(index), return JSONRPC_FALSE);
+		}
+		for (offset = index->offset ; bits ; bits &= bits - 1)
+			offset[n++] = (uint32_t)(pos + JSONRPC_SIMD_CTZ(bits));
+	}
+	index->offset[n] = (uint32_t)length;
+	index->size      = n;
+	index->values    = values;
+	index->ascii     = high ? JSONRPC_FALSE : JSONRPC_TRUE;
+
+	JSONRPC_THROW(error || in_string, return JSONRPC_FALSE);
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t is_delimiter (char c)
+{
+	switch (c)
+	{
+	case '\0': case ' ': case '\t': case '\n': case '\r':
+	case '{': case '}': case '[': case ']': case ':': case ',':
+		return JSONRPC_TRUE;
+	}
+	return JSONRPC_FALSE;
+}
+
+/**
+ * bytes >= 0x80 can only be valid in strings (anywhere else the token is malformed),
+ * so the UTF-8 of a document that has some ('ascii' not set) is checked string by string.
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t parse_string (char *json, uint32_t open, uint32_t close, jsonrpc_bool_t ascii, jsonrpc_simd_node_t *node)
+{
+	char	*str = json + open + 1;
+	size_t	length = close - open - 1;
+
+	JSONRPC_THROW(json[close] != '"', return JSONRPC_FALSE);
+	if (memchr(str, '\\', length) == NULL)
+	{
+		JSONRPC_THROW(!ascii && !jsonrpc_utf8_validate(str, length), return JSONRPC_FALSE);
+		json[close] = '\0';
+	}
+	else	// validates as it unescapes
+		JSONRPC_THROW(jsonrpc_string_unescape(str, &length) != json + close + 1, return JSONRPC_FALSE);
+	node->type            = JSONRPC_TYPE_STRING;
+	node->u.string.chars  = str;
+	node->u.string.length = (uint32_t)length;
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t parse_scalar (char *p, jsonrpc_simd_node_t *node)
+{
+	jsonrpc_json_t	number;
+	const char		*end;
+
+	switch (*p)
+	{
+	case 't':
+		JSONRPC_THROW(strncmp(p, "true", 4) != 0 || !is_delimiter(p[4]), return JSONRPC_FALSE);
+		node->type      = JSONRPC_TYPE_BOOLEAN;
+		node->u.boolean = JSONRPC_TRUE;
+		break;
+
+	case 'f':
+		JSONRPC_THROW(strncmp(p, "false", 5) != 0 || !is_delimiter(p[5]), return JSONRPC_FALSE);
+		node->type      = JSONRPC_TYPE_BOOLEAN;
+		node->u.boolean = JSONRPC_FALSE;
+		break;
+
+	case 'n':
+		JSONRPC_THROW(strncmp(p, "null", 4) != 0 || !is_delimiter(p[4]), return JSONRPC_FALSE);
+		node->type = JSONRPC_TYPE_NULL;
+		break;
+
+	default:
+		end = jsonrpc_number_parse(p, &number);
+		JSONRPC_THROW(end == NULL || !is_delimiter(*end), return JSONRPC_FALSE);
+		node->type = number.type;
+		if (number.type == JSONRPC_TYPE_INTEGER)
+			node->u.integer = number.u.integer;
+		else
+			node->u.number = number.u.number;
+		break;
+	}
+	return JSONRPC_TRUE;
+}
+
+/**
+ * stage 2: walk the index and fill the tape. strings are unescaped in place.
+ * 'tape' must have room for the values of the index + 1 nodes (a failing token takes one more).
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t build_tape (char *json, const uint32_t *index, size_t count, jsonrpc_bool_t ascii, jsonrpc_simd_node_t *tape)
+{
+	uint32_t	stack[JSONRPC_SIMD_MAX_DEPTH];
+	jsonrpc_simd_node_t	*node, *parent;
+	size_t		k = 0, n = 0;
+	int			depth = 0;
+	char		*p;
+
+VALUE:
+	p    = json + index[k++];
+	node = tape + n++;
+	node->skip = 1;
+	if (depth > 0)
+		tape[stack[depth - 1]].u.container.length++;
+
+	switch (*p)
+	{
+	case '{':
+	case '[':
+		JSONRPC_THROW(depth >= JSONRPC_SIMD_MAX_DEPTH, return JSONRPC_FALSE);
+		node->type = (*p == '{') ? JSONRPC_TYPE_OBJECT : JSONRPC_TYPE_ARRAY;
+		node->u.container.length = 0;
+		node->u.container.cursor = 0;
+		node->u.container.offset = 1;
+		stack[depth++] = (uint32_t)(node - tape);
+
+		if (json[index[k]] == (node->type == JSONRPC_TYPE_OBJECT ? '}' : ']'))
+		{
+			k++;
+			goto CLOSE;
+		}
+		if (node->type == JSONRPC_TYPE_OBJECT)
+			goto KEY;
+		goto VALUE;
+
+	case '"':
+		JSONRPC_THROW(!parse_string(json, index[k - 1], index[k], ascii, node), return JSONRPC_FALSE);
+		k++;
+		break;
+
+	default:
+		JSONRPC_THROW(!parse_scalar(p, node), return JSONRPC_FALSE);
+		break;
+	}
+
+NEXT:
+	if (depth == 0)
+		return (k == count) ? JSONRPC_TRUE : JSONRPC_FALSE;	// trailing garbage
+
+	parent = tape + stack[depth - 1];
+	p      = json + index[k++];
+	if (*p == ',')
+	{
+		if (parent->type == JSONRPC_TYPE_OBJECT)
+			goto KEY;
+		goto VALUE;
+	}
+	JSONRPC_THROW(*p != (parent->type == JSONRPC_TYPE_OBJECT ? '}' : ']'), return JSONRPC_FALSE);
+
+CLOSE:
+	parent = tape + stack[--depth];
+	parent->skip = (uint32_t)(n - (size_t)(parent - tape));
+	goto NEXT;
+
+KEY:
+	JSONRPC_THROW(json[index[k]] != '"', return JSONRPC_FALSE);
+	node = tape + n++;
+	node->skip = 1;
+	JSONRPC_THROW(!parse_string(json, index[k], index[k + 1], ascii, node), return JSONRPC_FALSE);
+	k += 2;
+	JSONRPC_THROW(json[index[k++]] != ':', return JSONRPC_FALSE);
+	goto VALUE;
+}
+
+/**
+ * parse 'json' in place if 'insitu' is set (tape and big index from 'arena'),
+ * otherwise a copy of 'json' is kept together with the tape.
+ */
+JSONRPC_PRIVATE jsonrpc_simd_doc_t * parse_document (const char *json, size_t length, jsonrpc_bool_t insitu, jsonrpc_arena_t *arena)
+{
+	jsonrpc_simd_index_t	index;
+	jsonrpc_simd_doc_t		*doc = NULL;
+	size_t		size;
+	char		*text;
+
+	JSONRPC_THROW(length >= UINT32_MAX
+		|| length >= ((size_t)-1 - sizeof(jsonrpc_simd_doc_t)) / (sizeof(jsonrpc_simd_node_t) + sizeof(uint32_t) + 1)
+		, return NULL
+	);
+
+	index.arena = insitu ? arena : NULL;
+	if (build_index(json, length, &index))
+	{
+		size = offsetof(jsonrpc_simd_doc_t, tape) + (index.values + 1) * sizeof(jsonrpc_simd_node_t);
+		if (insitu)
+		{
+			doc = (jsonrpc_simd_doc_t *)jsonrpc_arena_alloc(arena, size);
+			text = (char *)json;
+		}
+		else
+		{
+			doc = (jsonrpc_simd_doc_t *)jsonrpc_malloc(size + length + 1);
+			text = (char *)doc + size;
+			if (doc)
+				memcpy(text, json, length + 1);
+		}
+
+		if (doc)
+		{
+			doc->owned = insitu ? JSONRPC_FALSE : JSONRPC_TRUE;
+			if (!build_tape(text, index.offset, index.size, index.ascii, doc->tape))
+			{
+				if (doc->owned)
+					jsonrpc_free(doc);
+				doc = NULL;
+			}
+		}
+	}
+
+	if (index.offset != index.small && index.arena == NULL)
+		jsonrpc_free(index.offset);
+	return doc;
+}
+
+/**
+ * node of the child 'index' of a container (the key node for objects)
+ */
+JSONRPC_PRIVATE jsonrpc_simd_node_t * seek_child (jsonrpc_simd_node_t *v, size_t index)
+{
+	if (index < v->u.container.cursor)
+	{
+		v->u.container.cursor = 0;
+		v->u.container.offset = 1;
+	}
+	while (v->u.container.cursor < index)
+	{
+		if (v->type == JSONRPC_TYPE_OBJECT)
+			v->u.container.offset += 1 + v[v->u.container.offset + 1].skip;
+		else
+			v->u.container.offset += v[v->u.container.offset].skip;
+		v->u.container.cursor++;
+	}
+	return v + v->u.container.offset;
+}
+
+
+static jsonrpc_handle_t	jsonrpc_simd_parse_insitu (char *json, size_t length, jsonrpc_arena_t *arena)
+{
+	jsonrpc_simd_doc_t	*doc = parse_document(json, length, JSONRPC_TRUE, arena);
+
+	return doc ? (jsonrpc_handle_t)doc->tape : NULL;
+}
+
+static jsonrpc_handle_t	jsonrpc_simd_parse (const char *json)
+{
+	jsonrpc_simd_doc_t	*doc = parse_document(json, strlen(json), JSONRPC_FALSE, NULL);
+
+	return doc ? (jsonrpc_handle_t)doc->tape : NULL;
+}
+
+static void				jsonrpc_simd_release (jsonrpc_handle_t json)
+{
+	jsonrpc_simd_doc_t	*doc;
+
+	if (json == NULL)
+		return;
+
+	doc = JSONRPC_SIMD_DOC(json);
+	if (doc->owned)
+		jsonrpc_free(doc);
+}
+
+static jsonrpc_handle_t	jsonrpc_simd_get (jsonrpc_handle_t json, const char *key)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json, *member;
+	size_t	i;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return NULL;
+
+	for (i = 0, member = v + 1 ; i < v->u.container.length ; i++, member += 1 + member[1].skip)
+	{
+		if (strcmp(member->u.string.chars, key) == 0)
+			return (jsonrpc_handle_t)(member + 1);
+	}
+	return NULL;
+}
+
+static void				jsonrpc_simd_get_members (jsonrpc_handle_t json, const char * const *keys, size_t n, jsonrpc_handle_t *values)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json, *member;
+	size_t	i, k;
+
+	for (k = 0 ; k < n ; k++)
+		values[k] = NULL;
+
+	if (v->type != JSONRPC_TYPE_OBJECT)
+		return;
+
+	for (i = 0, member = v + 1 ; i < v->u.container.length ; i++, member += 1 + member[1].skip)
+	{
+		for (k = 0 ; k < n ; k++)
+		{
+			if (values[k] == NULL && strcmp(member->u.string.chars, keys[k]) == 0)
+			{
+				values[k] = (jsonrpc_handle_t)(member + 1);
+				break;
+			}
+		}
+	}
+}
+
+static jsonrpc_handle_t	jsonrpc_simd_get_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json;
+
+	if (v->type == JSONRPC_TYPE_ARRAY && index < v->u.container.length)
+		return (jsonrpc_handle_t)seek_child(v, index);
+	if (v->type == JSONRPC_TYPE_OBJECT && index < v->u.container.length)
+		return (jsonrpc_handle_t)(seek_child(v, index) + 1);
+	return NULL;
+}
+
+static const char *		jsonrpc_simd_get_key_at (jsonrpc_handle_t json, size_t index)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT && index < v->u.container.length)
+		return seek_child(v, index)->u.string.chars;
+	return NULL;
+}
+
+static jsonrpc_bool_t	jsonrpc_simd_valueof (jsonrpc_handle_t json, jsonrpc_json_t *value)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json;
+
+	value->type   = v->type;
+	value->length = 0;
+	switch (v->type)
+	{
+	case JSONRPC_TYPE_NUMBER:
+		value->u.number = v->u.number;
+		break;
+
+	case JSONRPC_TYPE_INTEGER:
+		value->u.integer = v->u.integer;
+		break;
+
+	case JSONRPC_TYPE_BOOLEAN:
+		value->u.boolean = v->u.boolean;
+		break;
+
+	case JSONRPC_TYPE_STRING:
+		value->u.string = v->u.string.chars;
+		value->length   = v->u.string.length;
+		break;
+
+	case JSONRPC_TYPE_OBJECT:
+	case JSONRPC_TYPE_ARRAY:
+		value->u.object = json;
+		break;
+
+	case JSONRPC_TYPE_NULL:
+		break;
+
+	default:
+		return JSONRPC_FALSE;
+	}
+	return JSONRPC_TRUE;
+}
+
+static size_t			jsonrpc_simd_length (jsonrpc_handle_t json)
+{
+	jsonrpc_simd_node_t	*v = (jsonrpc_simd_node_t *)json;
+
+	if (v->type == JSONRPC_TYPE_OBJECT || v->type == JSONRPC_TYPE_ARRAY)
+		return v->u.container.length;
+	return 0;
+}
+
+
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_simd (void)
+{
+	static const jsonrpc_json_plugin_t plugin_simd = {
+		jsonrpc_simd_parse,
+		jsonrpc_simd_release,
+		jsonrpc_simd_get,
+		jsonrpc_simd_get_at,
+		jsonrpc_simd_get_key_at,
+		jsonrpc_simd_valueof,
+		jsonrpc_simd_length,
+		jsonrpc_simd_get_members,
+		jsonrpc_simd_parse_insitu,
+		JSONRPC_TRUE	// strings are validated as they are scanned
+	};
+	return &plugin_simd;
+}
+
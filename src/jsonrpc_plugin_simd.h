@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef jsonrpc_jsonrpc_plugin_simd_h
+#define jsonrpc_jsonrpc_plugin_simd_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * built-in json plugin for large documents.
+ * finds the structural characters of 64 bytes at a time with SSE2/AVX2
+ * (selected at run time, scalar code on other CPUs) and builds a flat tape from that index.
+ */
+const jsonrpc_json_plugin_t	* jsonrpc_plugin_simd (void);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
+
@@ -11,11 +11,56 @@
 #include "jsonrpc_macro.h"
 #include "jsonrpc_memory.h"
 #include "jsonrpc_mstream.h"
+#include "jsonrpc_number.h"
+#include "jsonrpc_string.h"
+#include "jsonrpc_utf8.h"
+#include "jsonrpc_writer.h"
+
+#ifdef JSONRPC_HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 
 #define	JSONRPC_JSONAPI(server)	(&(server)->json)
 #define	JSONRPC_MEMSTREAM_NUM	3
+#define	JSONRPC_MEMSTREAM_CHUNK	16384
 #define	JSONRPC_TEMPVALUE_NUM	10
+#define	JSONRPC_ARENA_CHUNK		8192
+#define	JSONRPC_ARENA_PER_BYTE	32		///< arena a request byte may take in-situ (a value every 2 bytes, up to 48 bytes a value)
+#define	JSONRPC_RESULT_PREFIX	"{\"jsonrpc\":\"" JSONRPC_VERSION "\",\"result\":"
+#define	JSONRPC_ERROR_PREFIX	"{\"jsonrpc\":\"" JSONRPC_VERSION "\",\"error\":{\"code\":"
+/// response when even an error object can not be written (JSONRPC_ERROR_SERVER_OUT_OF_MEMORY)
+#define	JSONRPC_OUT_OF_MEMORY_OBJECT	JSONRPC_ERROR_PREFIX "-32098,\"message\":\"Server: Out of memory\"},\"id\":null}"
+
+/**
+ * evaluate 'expr' with the allocator of 'server' as the one of the calling thread
+ */
+#define	JSONRPC_WITH_ALLOCATOR(server, expr)	do {\
+		const jsonrpc_allocator_t *caller_ = jsonrpc_set_thread_allocator(&(server)->meter.allocator);\
+		expr;\
+		jsonrpc_set_thread_allocator(caller_);\
+	} while (0)
+
+/**
+ * allocator of the requests of 'server': in steady state, its allocator calls are reported
+ */
+#define	JSONRPC_SERVING_ALLOCATOR(server)	((server)->steady.on ? &(server)->meter.guard : &(server)->meter.allocator)
+
+#define	JSONRPC_SERVING(server, expr)	do {\
+		const jsonrpc_allocator_t *caller_ = jsonrpc_set_thread_allocator(JSONRPC_SERVING_ALLOCATOR(server));\
+		expr;\
+		jsonrpc_set_thread_allocator(caller_);\
+	} while (0)
+
+/**
+ * named parameter index entry
+ */
+typedef struct
+{
+	const char			*name;		///< NULL if empty slot
+	size_t				hash;
+	size_t				index;		///< declared position
+} jsonrpc_param_name_t;
 
 typedef struct
 {
@@ -24,15 +69,42 @@ typedef struct
 	jsonrpc_bool_t		has_return;
 	size_t				argc;
 	jsonrpc_param_t		*argv;
+	char				*types;		///< packed type signature (e.g. "iis")
+	size_t				types_hash;
+	jsonrpc_param_name_t	*names;	///< open addressing, power of 2 (NULL if positional only)
+	size_t				names_size;
 } jsonrpc_procedure_t;
 
+/**
+ * dispatch index entry: all overloads of a method name, in registration order
+ */
+typedef struct
+{
+	size_t				hash;
+	jsonrpc_procedure_t	**list;
+	size_t				count;
+	size_t				list_length;
+	jsonrpc_procedure_t	**index;	///< overloads hashed by type signature
+	size_t				index_size;
+} jsonrpc_proc_group_t;
 
-struct jsonrpc_server
+
+/**
+ * element of a batch: a parsed value, or the raw text of a split batch
+ */
+typedef struct
 {
-	jsonrpc_json_plugin_t	json;
-	jsonrpc_net_plugin_t	net;
+	jsonrpc_handle_t	json;
+	const char			*text;
+	size_t				length;
+} jsonrpc_batch_item_t;
 
-	jsonrpc_handle_t		net_handle;
+/**
+ * per-call temporaries: every thread executing requests has its own
+ */
+struct jsonrpc_exec_ctx
+{
+	jsonrpc_server_t		*server;
 
 	struct {
 		jsonrpc_mstream_t	*mstream[JSONRPC_MEMSTREAM_NUM];
@@ -46,9 +118,10 @@ struct jsonrpc_server
     } param;
 
 	struct {
-		void				*buf;
+		jsonrpc_param_t		*argv;	///< named params placed in declared order
+		size_t				*hash;	///< name hash of incoming params
 		size_t				size;
-	} tempbuf;
+	} named;
 
 	struct {
 		jsonrpc_json_t		value[JSONRPC_TEMPVALUE_NUM];
@@ -56,10 +129,97 @@ struct jsonrpc_server
 	} tempval;
 
 	struct {
-		jsonrpc_procedure_t	**list;
+		char				*buf;	///< request (or batch element) being parsed
+		size_t				size;
+	} text;
+	jsonrpc_arena_t			*arena;	///< memory of the request (json values of in-situ parsing), reset by the next one
+
+	struct {
+		jsonrpc_batch_item_t	*items;	///< elements of the current batch
+		size_t				alloc;
+	} batch;
+
+	struct {
+		jsonrpc_iovec_t		*list;	///< pieces of the last response
+		size_t				count;
+		size_t				alloc;
+	} iov;
+
+	struct {
+		jsonrpc_mstream_t	*stream;	///< attached to the buffer of jsonrpc_exec_ctx_execute_into
+		jsonrpc_bool_t		active;		///< the response goes to 'stream' instead of the ring
+	} output;
+};
+
+/**
+ * destination of a streamed batch response
+ */
+typedef struct
+{
+	jsonrpc_output_t	write;
+	void				*ctx;
+	size_t				count;		///< responses written so far
+	jsonrpc_error_t		error;		///< first error of 'write'
+	jsonrpc_bool_t		borrow;		///< 'write' keeps the data: only responses that outlive the batch are emitted
+} jsonrpc_emitter_t;
+
+#ifdef JSONRPC_HAVE_PTHREAD
+typedef struct
+{
+	jsonrpc_server_t	*server;
+	jsonrpc_exec_ctx_t	ctx;
+	pthread_t			thread;
+} jsonrpc_worker_t;
+#endif
+
+
+struct jsonrpc_server
+{
+	jsonrpc_json_plugin_t	json;
+	jsonrpc_net_plugin_t	net;
+
+	jsonrpc_handle_t		net_handle;
+
+	jsonrpc_meter_t			meter;		///< memory of the server (counted), made current on the threads working for it
+	jsonrpc_exec_ctx_t		ctx;		///< temporaries of jsonrpc_server_execute
+	unsigned int			arena_flags;	///< flags of the arenas of the execution contexts
+
+	struct {
+		size_t				trim;		///< scratch buffers of more bytes are trimmed between requests (0: never)
+		size_t				peak[JSONRPC_MEMORY_CLASSES];	///< most scratch memory of the server and its workers between requests
+	} memory;
+
+	struct {
+		jsonrpc_bool_t		on;			///< the scratch memory is preallocated for 'limits'
+		jsonrpc_limits_t	limits;
+	} steady;
+
+	struct {
+		jsonrpc_batch_order_t	order;
+		size_t				split;		///< batches of at least this many bytes are split before parsing (0: never)
+#ifdef JSONRPC_HAVE_PTHREAD
+		jsonrpc_worker_t	*workers;	///< run the batches of 'ctx' (not those of other contexts)
+		size_t				threads;
+		pthread_mutex_t		lock;
+		pthread_cond_t		wake;		///< a batch is posted (or 'quit')
+		pthread_cond_t		finish;		///< the last element of the batch is done
+		jsonrpc_bool_t		quit;
+
+		size_t				alloc;
+		jsonrpc_mstream_t	**slots;	///< response of each element
+		jsonrpc_bool_t		*ready;		///< element is done (streaming in request order)
+		size_t				*done;		///< element indices in completion order
+		size_t				count;
+		size_t				next;		///< next element to run
+		size_t				finished;
+		jsonrpc_bool_t		failed;		///< a response did not fit in memory
+#endif
+	} batch;
+
+	struct {
+		jsonrpc_proc_group_t	*table;		///< open addressing, power of 2
+		size_t				size;
 		size_t				count;
-		size_t				list_length;
-		jsonrpc_bool_t		sorted;
 	} proc;
 };
 
@@ -76,16 +236,17 @@ JSONRPC_PRIVATE int	check_null_func (void *plugin, size_t n)
 	return (int)n;
 }
 
-JSONRPC_PRIVATE jsonrpc_mstream_t * get_memstream (jsonrpc_server_t *self, jsonrpc_bool_t auto_release)
+JSONRPC_PRIVATE jsonrpc_mstream_t * get_memstream (jsonrpc_exec_ctx_t *self, jsonrpc_bool_t auto_release)
 {
 	size_t	i = self->stream.index;
 	int		n = JSONRPC_MEMSTREAM_NUM;
 	do
 	{
 		i = (i + 1) % JSONRPC_MEMSTREAM_NUM;
-		if (self->stream.mstream[i] == NULL)
+		if (self->stream.mstream[i] == NULL && (self->stream.mstream[i] = jsonrpc_mstream_open()) != NULL)
 		{
-			self->stream.mstream[i] = jsonrpc_mstream_open();
+			// big results and batches are appended in chunks, and joined once
+			jsonrpc_mstream_set_chunk(self->stream.mstream[i], JSONRPC_MEMSTREAM_CHUNK);
 		}
 	} while (n-- && (self->stream.used[i] || self->stream.mstream[i] == NULL));
 	if (n < 0)
@@ -97,7 +258,7 @@ JSONRPC_PRIVATE jsonrpc_mstream_t * get_memstream (jsonrpc_server_t *self, jsonr
 	return self->stream.mstream[i];
 }
 
-JSONRPC_PRIVATE void	release_memstream (jsonrpc_server_t *self, jsonrpc_mstream_t *stream)
+JSONRPC_PRIVATE void	release_memstream (jsonrpc_exec_ctx_t *self, jsonrpc_mstream_t *stream)
 {
 	int	n = JSONRPC_MEMSTREAM_NUM;
 	while (n--)
@@ -110,7 +271,7 @@ JSONRPC_PRIVATE void	release_memstream (jsonrpc_server_t *self, jsonrpc_mstream_
 	}
 }
 
-JSONRPC_PRIVATE jsonrpc_param_t * get_temp_param (jsonrpc_server_t *self, size_t size)
+JSONRPC_PRIVATE jsonrpc_param_t * get_temp_param (jsonrpc_exec_ctx_t *self, size_t size)
 {
 	if (self->param.argc < size)
 	{
@@ -126,19 +287,46 @@ JSONRPC_PRIVATE jsonrpc_param_t * get_temp_param (jsonrpc_server_t *self, size_t
 	return self->param.argv;
 }
 
-JSONRPC_PRIVATE void *	get_temp_buf (jsonrpc_server_t *self, size_t size)
+JSONRPC_PRIVATE jsonrpc_bool_t get_temp_named (jsonrpc_exec_ctx_t *self, size_t size)
+{
+	if (self->named.size < size)
+	{
+		jsonrpc_param_t	*argv = (jsonrpc_param_t *)jsonrpc_malloc(size * sizeof(jsonrpc_param_t));
+		size_t			*hash = (size_t *)jsonrpc_malloc(size * sizeof(size_t));
+
+		JSONRPC_THROW(argv == NULL || hash == NULL, {
+			jsonrpc_vfree(argv ? (void *)argv : (void *)hash, argv ? (void *)hash : NULL, NULL);
+			return JSONRPC_FALSE;
+		});
+		if (self->named.argv)
+			jsonrpc_vfree(self->named.argv, self->named.hash, NULL);
+		self->named.argv = argv;
+		self->named.hash = hash;
+		self->named.size = size;
+	}
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE char *	get_temp_buf (jsonrpc_exec_ctx_t *self, size_t size)
 {
-	if (self->tempbuf.size < size)
+	if (self->text.size < size)
 	{
-		void *buf = jsonrpc_realloc(self->tempbuf.buf, size);
+		char *buf = (char *)jsonrpc_realloc(self->text.buf, size);
 		JSONRPC_THROW(buf == NULL, return NULL);
-		self->tempbuf.buf  = buf;
-		self->tempbuf.size = size;
+		self->text.buf  = buf;
+		self->text.size = size;
 	}
-	return self->tempbuf.buf;
+	return self->text.buf;
+}
+
+JSONRPC_PRIVATE jsonrpc_arena_t *	get_arena (jsonrpc_exec_ctx_t *self)
+{
+	if (self->arena == NULL)
+		self->arena = jsonrpc_arena_open(JSONRPC_ARENA_CHUNK, self->server->arena_flags);
+	return self->arena;
 }
 
-JSONRPC_PRIVATE jsonrpc_json_t * get_temp_value (jsonrpc_server_t *self)
+JSONRPC_PRIVATE jsonrpc_json_t * get_temp_value (jsonrpc_exec_ctx_t *self)
 {
 	size_t	i = self->tempval.index;
 
@@ -148,30 +336,75 @@ JSONRPC_PRIVATE jsonrpc_json_t * get_temp_value (jsonrpc_server_t *self)
 	return self->tempval.value + i;
 }
 
+JSONRPC_PRIVATE void	clear_exec_ctx (jsonrpc_exec_ctx_t *self)
+{
+	size_t	i;
+
+	for (i = 0 ; i < JSONRPC_MEMSTREAM_NUM ; i++)
+	{
+		if (self->stream.mstream[i])
+			jsonrpc_mstream_close(self->stream.mstream[i]);
+	}
+	if (self->param.argv)
+		jsonrpc_free(self->param.argv);
+	if (self->named.argv)
+		jsonrpc_vfree(self->named.argv, self->named.hash, NULL);
+	if (self->text.buf)
+		jsonrpc_free(self->text.buf);
+	if (self->arena)
+		jsonrpc_arena_close(self->arena);
+	if (self->batch.items)
+		jsonrpc_free(self->batch.items);
+	if (self->iov.list)
+		jsonrpc_free(self->iov.list);
+	if (self->output.stream)
+		jsonrpc_mstream_close(self->output.stream);
+	memset(self, 0, sizeof(jsonrpc_exec_ctx_t));
+}
+
 
-JSONRPC_PRIVATE jsonrpc_bool_t	str_startwith (const char *str, char c)
+/**
+ * error of a request the plug-in could not parse: if allocations were refused
+ * for the memory limit meanwhile ('refused' before), the request may be fine
+ */
+JSONRPC_PRIVATE jsonrpc_error_t parse_error (jsonrpc_server_t *self, size_t refused)
 {
-	while (isspace(*str))
-		str++;
-	return (*str == c) ? JSONRPC_TRUE : JSONRPC_FALSE;
+	return (jsonrpc_meter_read(&self->meter.refused) != refused) ? JSONRPC_ERROR_SERVER_OUT_OF_MEMORY : JSONRPC_ERROR_PARSE_ERROR;
 }
 
-JSONRPC_PRIVATE const char *make_batch_object (jsonrpc_server_t *self, const char *request)
+/**
+ * untrusted input: malformed UTF-8 must not reach a handler. the plug-ins that
+ * do not reject it while parsing get only text checked here.
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t check_utf8 (jsonrpc_server_t *self, const char *data, size_t length)
 {
-	jsonrpc_mstream_t	*stream;
+	return JSONRPC_JSONAPI(self)->validates_utf8 || jsonrpc_utf8_validate(data, length);
+}
 
-	stream = get_memstream(self, JSONRPC_TRUE);
-	if (!stream)
-		return NULL;
-	jsonrpc_mstream_print(stream, "{\"batch\":%s}", request);
-	return jsonrpc_mstream_getbuf(stream);
+JSONRPC_PRIVATE jsonrpc_handle_t parse_json (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx, const char *data, size_t length)
+{
+	jsonrpc_arena_t	*arena;
+	char	*buf;
+
+	JSONRPC_THROW(!check_utf8(self, data, length), return NULL);
+
+	if (!JSONRPC_JSONAPI(self)->parse_insitu)
+		return JSONRPC_JSONAPI(self)->parse(data);
+
+	// one copy into a reused buffer, then no allocation at all while parsing
+	buf    = get_temp_buf(ctx, length + 1);
+	JSONRPC_THROW(buf == NULL, return NULL);
+	memcpy(buf, data, length + 1);
+
+	JSONRPC_THROW((arena = get_arena(ctx)) == NULL, return NULL);
+	return JSONRPC_JSONAPI(self)->parse_insitu(buf, length, arena);
 }
 
 JSONRPC_PRIVATE char * strdup_without_space (jsonrpc_server_t *self, const char *str)
 {
 	char *dup, *d;
 
-	dup = (char *)get_temp_buf(self, strlen(str) + 1);
+	dup = get_temp_buf(&self->ctx, strlen(str) + 1);
 	if (dup)
 	{
 		for (d = dup ; *str != '\0' ; str++)
@@ -237,68 +470,292 @@ JSONRPC_PRIVATE int parse_param_signature (jsonrpc_server_t *self, const char *p
 	return count;
 }
 
-JSONRPC_PRIVATE int compare_procedure_name (const void *arg1, const void *arg2)
+JSONRPC_PRIVATE size_t hash_name (const char *name)
+{
+	size_t	hash = 2166136261u;	// FNV-1a
+	size_t	n    = JSONRPC_NAME_LEN - 1;
+
+	for (; n && *name != '\0' ; n--, name++)
+	{
+		hash ^= (unsigned char)*name;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * a declared number ('i') also accepts an integer ('l'), which is converted for the method.
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t accept_type (char declared, jsonrpc_type_t actual)
 {
-	const jsonrpc_procedure_t *lhs = *(const jsonrpc_procedure_t **)arg1;
-	const jsonrpc_procedure_t *rhs = *(const jsonrpc_procedure_t **)arg2;
+	if (declared == (char)actual || (declared == JSONRPC_TYPE_NUMBER && actual == JSONRPC_TYPE_INTEGER))
+		return JSONRPC_TRUE;
+	return JSONRPC_FALSE;
+}
 
-	return strcmp(lhs->name, rhs->name);
+JSONRPC_PRIVATE char widen_type (jsonrpc_type_t type, jsonrpc_bool_t widen)
+{
+	return (widen && type == JSONRPC_TYPE_INTEGER) ? (char)JSONRPC_TYPE_NUMBER : (char)type;
 }
 
-JSONRPC_PRIVATE jsonrpc_procedure_t ** find_procedure (jsonrpc_server_t *self, const char *name, size_t *overload)
+/**
+ * @param widen	hash integers as numbers
+ */
+JSONRPC_PRIVATE size_t hash_param_types (const jsonrpc_param_t *argv, size_t argc, jsonrpc_bool_t widen)
 {
-	void 	*ret;
-	size_t	i, s, e;
-	jsonrpc_procedure_t	key, *pk;
+	size_t	hash = 2166136261u;	// FNV-1a
 
-	if (self->proc.count == 0)
-		return NULL;
+	for (; argc-- ; argv++)
+	{
+		hash ^= (unsigned char)widen_type(argv->json.type, widen);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t compile_param_types (jsonrpc_procedure_t *proc)
+{
+	size_t	i;
+
+	proc->types = (char *)jsonrpc_malloc(proc->argc + 1);
+	JSONRPC_THROW(proc->types == NULL, return JSONRPC_FALSE);
+
+	for (i = 0 ; i < proc->argc ; i++)
+		proc->types[i] = (char)proc->argv[i].json.type;
+	proc->types[i] = '\0';
+	proc->types_hash = hash_param_types(proc->argv, proc->argc, JSONRPC_FALSE);
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE const jsonrpc_param_name_t * lookup_param_name (const jsonrpc_procedure_t *proc, const char *name, size_t hash)
+{
+	size_t	mask, i;
+	const jsonrpc_param_name_t	*entry;
+
+	mask = proc->names_size - 1;
+	for (i = hash & mask ; (entry = proc->names + i)->name ; i = (i + 1) & mask)
+	{
+		if (entry->hash == hash && strcmp(entry->name, name) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t compile_param_names (jsonrpc_procedure_t *proc)
+{
+	size_t	size, mask, hash, i, j;
+
+	if (proc->argc == 0 || proc->argv[0].name[0] == '\0')
+		return JSONRPC_ERROR_OK;	// positional only
+
+	for (size = 4 ; size < proc->argc * 2 ; size *= 2)
+		;
+	proc->names = (jsonrpc_param_name_t *)jsonrpc_calloc(size, sizeof(jsonrpc_param_name_t));
+	JSONRPC_THROW(proc->names == NULL, return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+	proc->names_size = size;
+
+	mask = size - 1;
+	for (i = 0 ; i < proc->argc ; i++)
+	{
+		hash = hash_name(proc->argv[i].name);
+		JSONRPC_THROW(lookup_param_name(proc, proc->argv[i].name, hash) != NULL, return JSONRPC_ERROR_INVALID_PARAMS);	// duplicated name
+
+		for (j = hash & mask ; proc->names[j].name ; j = (j + 1) & mask)
+			;
+		proc->names[j].name  = proc->argv[i].name;
+		proc->names[j].hash  = hash;
+		proc->names[j].index = i;
+	}
+	return JSONRPC_ERROR_OK;
+}
+
+JSONRPC_PRIVATE jsonrpc_procedure_t ** lookup_overload (jsonrpc_proc_group_t *group, const jsonrpc_procedure_t *proc)
+{
+	size_t	mask, i;
+
+	mask = group->index_size - 1;
+	for (i = proc->types_hash & mask ; group->index[i] ; i = (i + 1) & mask)
+	{
+		if (group->index[i]->types_hash == proc->types_hash
+			&& group->index[i]->argc == proc->argc
+			&& memcmp(group->index[i]->types, proc->types, proc->argc) == 0)
+			break;
+	}
+	return group->index + i;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t index_overloads (jsonrpc_proc_group_t *group)
+{
+	jsonrpc_procedure_t	**index, **slot;
+	size_t	size, i;
+
+	for (size = 4 ; size < group->count * 2 ; size *= 2)
+		;
+	index = (jsonrpc_procedure_t **)jsonrpc_calloc(size, sizeof(jsonrpc_procedure_t *));
+	JSONRPC_THROW(index == NULL, return JSONRPC_FALSE);
+
+	if (group->index)
+		jsonrpc_free(group->index);
+	group->index      = index;
+	group->index_size = size;
+
+	for (i = 0 ; i < group->count ; i++)
+	{
+		slot = lookup_overload(group, group->list[i]);
+		if (*slot == NULL)	// first registered wins
+			*slot = group->list[i];
+	}
+	return JSONRPC_TRUE;
+}
+
+/**
+ * select the overload whose signature equals the types of the positional params,
+ * then the one declaring numbers for all integers, then any overload accepting the params.
+ */
+JSONRPC_PRIVATE jsonrpc_procedure_t * select_overload (jsonrpc_proc_group_t *group, size_t paramc, const jsonrpc_param_t *paramv)
+{
+	jsonrpc_procedure_t	*proc;
+	jsonrpc_bool_t		widen;
+	size_t	hash, mask, i, j;
+
+	mask = group->index_size - 1;
+	for (widen = JSONRPC_FALSE ; widen <= JSONRPC_TRUE ; widen++)
+	{
+		hash = hash_param_types(paramv, paramc, widen);
+		for (i = hash & mask ; (proc = group->index[i]) != NULL ; i = (i + 1) & mask)
+		{
+			if (proc->types_hash != hash || proc->argc != paramc)
+				continue;
+			for (j = 0 ; j < paramc && proc->types[j] == widen_type(paramv[j].json.type, widen) ; j++)
+				;
+			if (j == paramc)
+				return proc;
+		}
+	}
+
+	for (i = 0 ; i < group->count ; i++)	// mixed 'i' and 'l'
+	{
+		proc = group->list[i];
+		if (proc->argc != paramc)
+			continue;
+		for (j = 0 ; j < paramc && accept_type(proc->types[j], paramv[j].json.type) ; j++)
+			;
+		if (j == paramc)
+			return proc;
+	}
+	return NULL;
+}
+
+/**
+ * pass integers as numbers where the method declared a number.
+ */
+JSONRPC_PRIVATE void convert_params (const jsonrpc_procedure_t *proc, size_t paramc, jsonrpc_param_t *paramv)
+{
+	size_t	i;
 
-	if (!self->proc.sorted)
+	for (i = 0 ; i < paramc ; i++)
 	{
-		if (self->proc.count > 1)
-			qsort(self->proc.list, self->proc.count, sizeof(jsonrpc_procedure_t *), compare_procedure_name);
-		self->proc.sorted = JSONRPC_TRUE;
+		if (proc->types[i] == (char)JSONRPC_TYPE_NUMBER && paramv[i].json.type == JSONRPC_TYPE_INTEGER)
+		{
+			paramv[i].json.type     = JSONRPC_TYPE_NUMBER;
+			paramv[i].json.u.number = (double)paramv[i].json.u.integer;
+		}
 	}
+}
+
+JSONRPC_PRIVATE jsonrpc_proc_group_t * lookup_procedure_group (jsonrpc_server_t *self, const char *name, size_t hash)
+{
+	size_t	mask, i;
+	jsonrpc_proc_group_t	*group;
 
-	JSONRPC_STRNCPY(key.name, name, JSONRPC_NAME_LEN);
-	pk  = &key;
-	ret = bsearch(&pk, self->proc.list, self->proc.count, sizeof(jsonrpc_procedure_t *), compare_procedure_name);
-	if (ret == NULL)
+	if (self->proc.size == 0)
 		return NULL;
 
-	i   = ((size_t)ret - (size_t)self->proc.list) / sizeof(jsonrpc_procedure_t *);
-	for (s = i ; s > 0 && strcmp(self->proc.list[s - 1]->name, name) == 0 ; s--)
-		; // find first position of overloaded method
-	for (e = i ; e < self->proc.count - 1 && strcmp(self->proc.list[e + 1]->name, name) == 0 ; e++)
-		; // find last position of overloaded method
+	mask = self->proc.size - 1;
+	for (i = hash & mask ; ; i = (i + 1) & mask)
+	{
+		group = self->proc.table + i;
+		if (group->list == NULL)
+			return group;	// empty slot
+		if (group->hash == hash && strncmp(group->list[0]->name, name, JSONRPC_NAME_LEN - 1) == 0)
+			return group;
+	}
+}
+
+JSONRPC_PRIVATE jsonrpc_proc_group_t * find_procedure (jsonrpc_server_t *self, const char *name)
+{
+	jsonrpc_proc_group_t	*group;
 
-	if (overload)
-		*overload = e - s + 1;
-	return self->proc.list + s;
+	group = lookup_procedure_group(self, name, hash_name(name));
+	if (group == NULL || group->list == NULL)
+		return NULL;
+	return group;
 }
 
+JSONRPC_PRIVATE jsonrpc_bool_t grow_procedure_table (jsonrpc_server_t *self)
+{
+	jsonrpc_proc_group_t	*table, *old;
+	size_t	size, mask, i, j;
+
+	size  = self->proc.size ? self->proc.size * 2 : 64/* default */;
+	table = (jsonrpc_proc_group_t *)jsonrpc_calloc(size, sizeof(jsonrpc_proc_group_t));
+	JSONRPC_THROW(table == NULL, return JSONRPC_FALSE);
+
+	mask = size - 1;
+	for (i = 0, old = self->proc.table ; i < self->proc.size ; i++)
+	{
+		if (old[i].list == NULL)
+			continue;
+		for (j = old[i].hash & mask ; table[j].list ; j = (j + 1) & mask)
+			;
+		memcpy(table + j, old + i, sizeof(jsonrpc_proc_group_t));
+	}
+	if (old)
+		jsonrpc_free(old);
+	self->proc.table = table;
+	self->proc.size  = size;
+	return JSONRPC_TRUE;
+}
 
 JSONRPC_PRIVATE jsonrpc_bool_t add_procedure (jsonrpc_server_t *self, jsonrpc_procedure_t *proc)
 {
-	if (self->proc.count == self->proc.list_length)
-	{
-		size_t	size;
-		if (self->proc.list_length == 0)
-			size = 32;	// default
-		else
-			size = self->proc.list_length * 2;
+	jsonrpc_proc_group_t	*group;
+	size_t	hash;
 
-		JSONRPC_THROW(
-			(self->proc.list = (jsonrpc_procedure_t **)jsonrpc_realloc(
-							self->proc.list, sizeof(jsonrpc_procedure_t *) * size)) == NULL
-			, return JSONRPC_FALSE
-		);
-		self->proc.list_length = size;
+	if ((self->proc.count + 1) * 2 > self->proc.size)	// keep load factor <= 0.5
+	{
+		JSONRPC_THROW(!grow_procedure_table(self), return JSONRPC_FALSE);
 	}
 
-	self->proc.list[self->proc.count++] = proc;
-	self->proc.sorted = JSONRPC_FALSE;
+	hash  = hash_name(proc->name);
+	group = lookup_procedure_group(self, proc->name, hash);
+	if (group->count == group->list_length)
+	{
+		jsonrpc_procedure_t	**list;
+		size_t	size = group->list_length ? group->list_length * 2 : 2/* default */;
+
+		list = (jsonrpc_procedure_t **)jsonrpc_realloc(group->list, sizeof(jsonrpc_procedure_t *) * size);
+		JSONRPC_THROW(list == NULL, return JSONRPC_FALSE);
+		group->list        = list;
+		group->list_length = size;
+	}
+	if (group->count == 0)
+	{
+		group->hash = hash;
+		self->proc.count++;
+	}
+	group->list[group->count++] = proc;
+	if (!index_overloads(group))
+	{
+		if (--group->count == 0)	// the name was new: the slot is empty again
+		{
+			jsonrpc_free(group->list);
+			group->list        = NULL;
+			group->list_length = 0;
+			self->proc.count--;
+		}
+		return JSONRPC_FALSE;
+	}
 	return JSONRPC_TRUE;
 }
 
@@ -330,9 +787,43 @@ JSONRPC_PRIVATE const char * get_error_message (jsonrpc_error_t error)
 }
 
 
-JSONRPC_PRIVATE const char * get_error_object (jsonrpc_server_t *self, jsonrpc_error_t error, const jsonrpc_json_t *id)
+JSONRPC_PRIVATE jsonrpc_bool_t print_id (jsonrpc_mstream_t *stream, const jsonrpc_json_t *id)
+{
+	char	buf[JSONRPC_NUMBER_BUF_LEN];
+	int		ret;
+
+	if (id && id->type == JSONRPC_TYPE_INTEGER)
+	{
+		ret = jsonrpc_mstream_write(stream, ",\"id\":", 6);
+		ret |= jsonrpc_mstream_write(stream, buf, jsonrpc_number_print_integer(buf, id->u.integer));
+	}
+	else if (id && id->type == JSONRPC_TYPE_NUMBER)
+	{
+		ret = jsonrpc_mstream_write(stream, ",\"id\":", 6);
+		ret |= jsonrpc_mstream_write(stream, buf, jsonrpc_number_print_double(buf, id->u.number));
+	}
+	else if (id && id->type == JSONRPC_TYPE_STRING)
+	{
+		ret = jsonrpc_mstream_write(stream, ",\"id\":", 6);
+		ret |= jsonrpc_mstream_write_string(stream, id->u.string, id->length);
+	}
+	else
+		ret = jsonrpc_mstream_write(stream, ",\"id\":null", 10);
+	return (ret < 0) ? JSONRPC_FALSE : JSONRPC_TRUE;
+}
+
+/**
+ * id of the responses to errors of the server that have no request to answer (e.g. out of memory)
+ */
+JSONRPC_PRIVATE const jsonrpc_json_t	s_null_id = { JSONRPC_TYPE_NULL, 0, { 0 } };
+
+JSONRPC_PRIVATE const char * get_error_object (jsonrpc_exec_ctx_t *ctx, jsonrpc_error_t error, const jsonrpc_json_t *id)
 {
 	jsonrpc_mstream_t	*stream;
+	const char			*message = get_error_message(error);
+	const char			*response;
+	char				buf[JSONRPC_NUMBER_BUF_LEN];
+	int					ret;
 
 	if (id == NULL
 		&& error != JSONRPC_ERROR_PARSE_ERROR
@@ -341,33 +832,37 @@ JSONRPC_PRIVATE const char * get_error_object (jsonrpc_server_t *self, jsonrpc_e
 		return NULL;	// The server MUST NOT reply except "Parse error/Invalid Request".
 	}
 
-	JSONRPC_THROW((stream = get_memstream(self, JSONRPC_TRUE)) == NULL, return NULL);
+	// a response cut short by the memory limit would be invalid JSON: fall back to a static one
+	JSONRPC_THROW((stream = get_memstream(ctx, JSONRPC_TRUE)) == NULL, return JSONRPC_OUT_OF_MEMORY_OBJECT);
 
-	jsonrpc_mstream_print(stream, "{");
+	ret = jsonrpc_mstream_write(stream, JSONRPC_ERROR_PREFIX, sizeof(JSONRPC_ERROR_PREFIX) - 1);
 	{
-		jsonrpc_mstream_print(stream, "\"jsonrpc\":\"%s\"", JSONRPC_VERSION);
-		jsonrpc_mstream_print(stream, ",\"error\":{");
-		{
-			jsonrpc_mstream_print(stream, "\"code\":%d,\"message\":\"%s\"", (int)error, get_error_message(error));
-		}
-		jsonrpc_mstream_print(stream, "}");
-		if (id)
-		{
-			if (id->type == JSONRPC_TYPE_NUMBER)
-				jsonrpc_mstream_print(stream, ",\"id\":%.0lf", id->u.number);
-			else if (id->type == JSONRPC_TYPE_STRING)
-				jsonrpc_mstream_print(stream, ",\"id\":\"%s\"", id->u.string);
-			else
-				jsonrpc_mstream_print(stream, ",\"id\":null");
-		}
-		else jsonrpc_mstream_print(stream, ",\"id\":null");
+		ret |= jsonrpc_mstream_write(stream, buf, jsonrpc_number_print_integer(buf, error));
+		ret |= jsonrpc_mstream_write(stream, ",\"message\":\"", 12);
+		ret |= jsonrpc_mstream_write(stream, message, strlen(message));
+		ret |= jsonrpc_mstream_write(stream, "\"}", 2);
+		JSONRPC_THROW(!print_id(stream, id), return JSONRPC_OUT_OF_MEMORY_OBJECT);
 	}
-	jsonrpc_mstream_print(stream, "}");
-
-	return jsonrpc_mstream_getbuf(stream);
+	ret |= jsonrpc_mstream_write(stream, "}", 1);
+	JSONRPC_THROW(ret < 0 || (response = jsonrpc_mstream_getbuf(stream)) == NULL, return JSONRPC_OUT_OF_MEMORY_OBJECT);
+	return response;
 }
 
 
+/**
+ * 'valueof' of the plug-in, making sure a string carries its length
+ * (a plug-in that does not know it leaves 0)
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t get_value (jsonrpc_server_t *self, jsonrpc_handle_t json, jsonrpc_json_t *value)
+{
+	value->length = 0;
+	JSONRPC_THROW(!JSONRPC_JSONAPI(self)->valueof(json, value), return JSONRPC_FALSE);
+
+	if (value->type == JSONRPC_TYPE_STRING && value->length == 0 && value->u.string)
+		value->length = strlen(value->u.string);
+	return JSONRPC_TRUE;
+}
+
 JSONRPC_PRIVATE jsonrpc_bool_t is_valid_json_value (const jsonrpc_json_t *value)
 {
 	switch(value->type)
@@ -392,20 +887,18 @@ JSONRPC_PRIVATE jsonrpc_bool_t is_valid_json_value (const jsonrpc_json_t *value)
 
 JSONRPC_PRIVATE const jsonrpc_json_t * get_json_value (
 								  jsonrpc_server_t *self
-								, jsonrpc_handle_t handle
-								, const char *key
+								, jsonrpc_exec_ctx_t *ctx
+								, jsonrpc_handle_t val
 								, const char *signature
 							)
 {
-	jsonrpc_handle_t		val;
-	const jsonrpc_json_t	*ret;
+	jsonrpc_json_t	*ret;
 
-	val = JSONRPC_JSONAPI(self)->get(handle, key);
 	if (!val)
 		return NULL;
 
-	ret = get_temp_value(self);
-	if (!JSONRPC_JSONAPI(self)->valueof(val, ret))
+	ret = get_temp_value(ctx);
+	if (!get_value(self, val, ret))
 		return NULL;
 
 	if (signature && strchr(signature, (int)ret->type) == NULL)
@@ -419,6 +912,7 @@ JSONRPC_PRIVATE const jsonrpc_json_t * get_json_value (
 
 JSONRPC_PRIVATE jsonrpc_error_t parse_request (
 								  jsonrpc_server_t *self
+								, jsonrpc_exec_ctx_t *ctx
 								, jsonrpc_handle_t req
 								, const jsonrpc_json_t **version
 								, const jsonrpc_json_t **method
@@ -426,26 +920,34 @@ JSONRPC_PRIVATE jsonrpc_error_t parse_request (
 								, const jsonrpc_json_t **id
 							)
 {
+	static const char * const	keys[] = {"jsonrpc", "method", "params", "id"};
+	jsonrpc_handle_t		members[4];
 	const jsonrpc_json_t	*val;
+	size_t	i;
 
-	JSONRPC_THROW((val = get_json_value(self, req, "jsonrpc", "s")) == NULL
+	if (JSONRPC_JSONAPI(self)->get_members)
+		JSONRPC_JSONAPI(self)->get_members(req, keys, 4, members);
+	else for (i = 0 ; i < 4 ; i++)
+		members[i] = JSONRPC_JSONAPI(self)->get(req, keys[i]);
+
+	JSONRPC_THROW((val = get_json_value(self, ctx, members[0], "s")) == NULL
 		, return JSONRPC_ERROR_INVALID_REQUEST
 	);
 	*version = val;
 
-	JSONRPC_THROW((val = get_json_value(self, req, "method", "s")) == NULL
+	JSONRPC_THROW((val = get_json_value(self, ctx, members[1], "s")) == NULL
 		, return JSONRPC_ERROR_INVALID_REQUEST
 	);
 	*method = val;
 
-	val = get_json_value(self, req, "params", NULL);
+	val = get_json_value(self, ctx, members[2], NULL);
 	JSONRPC_THROW(val && val->type != JSONRPC_TYPE_OBJECT && val->type != JSONRPC_TYPE_ARRAY
 		, return JSONRPC_ERROR_INVALID_REQUEST
 	);
 	*params = val;
 
-	val = get_json_value(self, req, "id", NULL);
-	JSONRPC_THROW(val && val->type != JSONRPC_TYPE_NUMBER && val->type != JSONRPC_TYPE_STRING
+	val = get_json_value(self, ctx, members[3], NULL);
+	JSONRPC_THROW(val && val->type != JSONRPC_TYPE_NUMBER && val->type != JSONRPC_TYPE_INTEGER && val->type != JSONRPC_TYPE_STRING
 		, return JSONRPC_ERROR_INVALID_REQUEST
 	);
 	*id = val;
@@ -455,6 +957,7 @@ JSONRPC_PRIVATE jsonrpc_error_t parse_request (
 
 JSONRPC_PRIVATE jsonrpc_error_t parse_params (
 								  jsonrpc_server_t *self
+								, jsonrpc_exec_ctx_t *ctx
 								, const jsonrpc_json_t *params
 								, size_t *paramc
 								, jsonrpc_param_t **paramv
@@ -464,7 +967,6 @@ JSONRPC_PRIVATE jsonrpc_error_t parse_params (
 	jsonrpc_param_t		*pv;
 	jsonrpc_handle_t	handle;
 	const char 			*key;
-	const jsonrpc_json_t	*value;
 
 	if (params)
 		n = JSONRPC_JSONAPI(self)->length(params->u.object);
@@ -477,7 +979,7 @@ JSONRPC_PRIVATE jsonrpc_error_t parse_params (
 		return JSONRPC_ERROR_OK;
 	}
 
-	pv = get_temp_param(self, n);
+	pv = get_temp_param(ctx, n);
 	JSONRPC_THROW(pv == NULL, return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
 
 	for (i = 0 ; i < n ; i++)
@@ -485,309 +987,958 @@ JSONRPC_PRIVATE jsonrpc_error_t parse_params (
 		handle = JSONRPC_JSONAPI(self)->get_at(params->u.object, i);
 		JSONRPC_THROW(!handle, return JSONRPC_ERROR_SERVER_INTERNAL);
 
-		value  = get_temp_value(self);
-		if (!JSONRPC_JSONAPI(self)->valueof(handle, value))
-			value = NULL;
-		JSONRPC_THROW(value == NULL || !is_valid_json_value(value), return JSONRPC_ERROR_SERVER_INTERNAL);
+		// value goes straight into its param (the tempval ring is too small for many params)
+		JSONRPC_THROW(!get_value(self, handle, &(pv[i].json)) || !is_valid_json_value(&(pv[i].json))
+			, return JSONRPC_ERROR_SERVER_INTERNAL
+		);
 
 		if (params->type == JSONRPC_TYPE_OBJECT)
 		{
 			JSONRPC_THROW((key = JSONRPC_JSONAPI(self)->get_key_at(params->u.object, i)) == NULL, return JSONRPC_ERROR_SERVER_INTERNAL);
 			JSONRPC_STRNCPY(pv[i].name, key, JSONRPC_NAME_LEN);
 		}
-		memcpy(&(pv[i].json), value, sizeof(jsonrpc_json_t));
 	}
 	*paramc = n;
 	*paramv = pv;
 	return JSONRPC_ERROR_OK;
 }
 
-JSONRPC_PRIVATE int compare_param_index (const void *arg1, const void *arg2)
-{
-	const jsonrpc_param_t *lhs = (const jsonrpc_param_t *)arg1;
-	const jsonrpc_param_t *rhs = (const jsonrpc_param_t *)arg2;
-
-	return (int)lhs->index - (int)rhs->index;
-}
-
-JSONRPC_PRIVATE jsonrpc_bool_t match_params_and_sort (
-									  jsonrpc_server_t *self
-									, jsonrpc_procedure_t *proc
+/**
+ * place each named param directly into its declared slot of 'argv'.
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t match_named_params (
+									  jsonrpc_procedure_t *proc
 									, size_t paramc
-									, jsonrpc_param_t *paramv
+									, const jsonrpc_param_t *paramv
+									, const size_t *hash
+									, jsonrpc_param_t *argv
 								)
 {
-	jsonrpc_bool_t	do_sort;
 	size_t			i, j;
-	size_t			skip_flag;	// for optimize
+	const jsonrpc_param_name_t	*entry;
 
-	if (proc->argc != paramc)
+	if (proc->argc != paramc || proc->names == NULL)
 		return JSONRPC_FALSE;
 
-	if (paramv[0].name[0] == '\0') // check matched (without name)
-	{
-		for (i = 0 ; i < proc->argc ; i++)
-		{
-			if (proc->argv[i].json.type != paramv[i].json.type)
-				break;
-		}
-		return i == proc->argc ? JSONRPC_TRUE : JSONRPC_FALSE;
-	}
+	for (i = 0 ; i < paramc ; i++)
+		argv[i].index = paramc;	// not filled
 
-	do_sort = JSONRPC_FALSE;
-	for (i = 0, skip_flag = 0 ; i < proc->argc ; i++)
+	for (j = 0 ; j < paramc ; j++)
 	{
-		for (j = 0 ; j < paramc ; j++)
-		{
-			if (j < 32 && (skip_flag & (1 << j)))
-				continue;
-			if (proc->argv[i].json.type != paramv[j].json.type)
-				continue;
-			if (strcmp(proc->argv[i].name, paramv[j].name) != 0)
-				continue;
-
-			if (j != i)
-				do_sort = JSONRPC_TRUE;
-			paramv[j].index = i;
-			if (j < 32)
-				skip_flag |= (1 << j);
-			break;
-		}
-		if (j == paramc)
+		entry = lookup_param_name(proc, paramv[j].name, hash[j]);
+		if (entry == NULL)
 			return JSONRPC_FALSE;
+
+		i = entry->index;
+		if (!accept_type((char)proc->argv[i].json.type, paramv[j].json.type) || argv[i].index == i)
+			return JSONRPC_FALSE;	// type mismatch or duplicated
+
+		memcpy(argv + i, paramv + j, sizeof(jsonrpc_param_t));
+		argv[i].index = i;
 	}
-	if (do_sort && paramc > 1)
-		qsort(paramv, paramc, sizeof(jsonrpc_param_t), compare_param_index);
 	return JSONRPC_TRUE;
 }
 
-JSONRPC_PRIVATE const char * execute_request (jsonrpc_server_t *self, jsonrpc_handle_t request)
+/**
+ * execute a call, writing the response to 'out' (NULL: a stream of the ring)
+ */
+JSONRPC_PRIVATE const char * execute_request (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx, jsonrpc_handle_t request, jsonrpc_mstream_t *out)
 {
 	const jsonrpc_json_t	*version;
 	const jsonrpc_json_t	*method;
 	const jsonrpc_json_t	*params;
 	const jsonrpc_json_t	*id;
 	jsonrpc_error_t			err;
-	jsonrpc_procedure_t		**procs, *proc;
-	size_t					i, n;
+	jsonrpc_proc_group_t	*group;
+	jsonrpc_procedure_t		*proc;
+	size_t					i;
 	size_t					paramc;
 	jsonrpc_param_t			*paramv;
-	jsonrpc_mstream_t		*result;
 	jsonrpc_mstream_t		*response;
+	jsonrpc_writer_t		result;
 
 	//--> {"jsonrpc": "2.0", "method": "subtract", "params": {"subtrahend": 23, "minuend": 42}, "id": 3}
 
-	JSONRPC_THROW(parse_request(self, request, &version, &method, &params, &id) != JSONRPC_ERROR_OK
-		, return get_error_object(self, JSONRPC_ERROR_INVALID_REQUEST, NULL)
+	JSONRPC_THROW(parse_request(self, ctx, request, &version, &method, &params, &id) != JSONRPC_ERROR_OK
+		, return get_error_object(ctx, JSONRPC_ERROR_INVALID_REQUEST, NULL)
 	);
 	JSONRPC_THROW(strcmp(version->u.string, JSONRPC_VERSION) != 0
-		, return get_error_object(self, JSONRPC_ERROR_INVALID_REQUEST, NULL)
+		, return get_error_object(ctx, JSONRPC_ERROR_INVALID_REQUEST, NULL)
 	);
 
-	procs = find_procedure(self, method->u.string, &n);
-	JSONRPC_THROW(procs == NULL
-		, return get_error_object(self, JSONRPC_ERROR_METHOD_NOT_FOUND, id)
+	group = find_procedure(self, method->u.string);
+	JSONRPC_THROW(group == NULL
+		, return get_error_object(ctx, JSONRPC_ERROR_METHOD_NOT_FOUND, id)
 	);
 
-	err = parse_params(self, params, &paramc, &paramv);
-	JSONRPC_THROW(err != JSONRPC_ERROR_OK, return get_error_object(self, err, id));
+	err = parse_params(self, ctx, params, &paramc, &paramv);
+	JSONRPC_THROW(err != JSONRPC_ERROR_OK, return get_error_object(ctx, err, id));
 
-	if (paramc > 0)
+	if (paramc == 0)
 	{
-		for (i = 0 ; i < n ; i++)
-		{
-			if (match_params_and_sort(self, procs[i], paramc, paramv))
-				break;
-		}
-		if (i == n)
-			return get_error_object(self, JSONRPC_ERROR_METHOD_NOT_FOUND, id);
-		proc = procs[i];
-	} else proc = procs[0];
-
+		proc = select_overload(group, 0, NULL);
+		if (proc == NULL)
+			proc = group->list[0];
+	}
+	else if (paramv[0].name[0] == '\0')	// positional
+	{
+		proc = select_overload(group, paramc, paramv);
+		JSONRPC_THROW(proc == NULL, return get_error_object(ctx, JSONRPC_ERROR_METHOD_NOT_FOUND, id));
+	}
+	else
+	{
+		JSONRPC_THROW(!get_temp_named(ctx, paramc)
+			, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
+		);
+		for (i = 0 ; i < paramc ; i++)
+			ctx->named.hash[i] = hash_name(paramv[i].name);
+
+		for (i = 0 ; i < group->count ; i++)
+		{
+			if (match_named_params(group->list[i], paramc, paramv, ctx->named.hash, ctx->named.argv))
+				break;
+		}
+		if (i == group->count)
+			return get_error_object(ctx, JSONRPC_ERROR_METHOD_NOT_FOUND, id);
+		proc   = group->list[i];
+		paramv = ctx->named.argv;
+	}
+	convert_params(proc, paramc, paramv);
+
 	JSONRPC_THROW((id && !proc->has_return) || (!id && proc->has_return)
-		, return get_error_object(self, JSONRPC_ERROR_METHOD_NOT_FOUND, id)
+		, return get_error_object(ctx, JSONRPC_ERROR_METHOD_NOT_FOUND, id)
 	);
 
-	if (id == NULL) // Notification
+	if (id == NULL) // Notification: scratch memory only
 	{
-		(void)proc->method((int)paramc, paramv, NULL, NULL);
+		jsonrpc_writer_init(&result, NULL, get_arena(ctx));
+		(void)proc->method((int)paramc, paramv, NULL, (void *)&result);
 		return NULL;
 	}
 
-	JSONRPC_THROW((result = get_memstream(self, JSONRPC_TRUE)) == NULL
-		, return get_error_object(self, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
-	);
-	err = proc->method((int)paramc, paramv
-			, (void (*)(void *ctx, const char *,...))jsonrpc_mstream_print
-			, (void *)result
+	if ((response = out) != NULL)
+		jsonrpc_mstream_rewind(response);
+	else
+	{
+		JSONRPC_THROW((response = get_memstream(ctx, JSONRPC_TRUE)) == NULL
+			, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
 		);
-	JSONRPC_THROW(err != JSONRPC_ERROR_OK, return get_error_object(self, err, id));
-	JSONRPC_THROW((response = get_memstream(self, JSONRPC_TRUE)) == NULL
-		, return get_error_object(self, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
+	}
+
+	// the method writes its result right into the response
+	JSONRPC_THROW(jsonrpc_mstream_write(response, JSONRPC_RESULT_PREFIX, sizeof(JSONRPC_RESULT_PREFIX) - 1) < 0
+		, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
+	);
+	jsonrpc_writer_init(&result, response, get_arena(ctx));
+	err = proc->method((int)paramc, paramv, jsonrpc_writer_print, (void *)&result);
+	if (err == JSONRPC_ERROR_OK)
+		err = jsonrpc_writer_finish(&result);
+	JSONRPC_THROW(err != JSONRPC_ERROR_OK, return get_error_object(ctx, err, id));
+
+	// a response cut short by the memory limit is not sent as it is
+	JSONRPC_THROW(!print_id(response, id) || jsonrpc_mstream_write(response, "}", 1) < 0 || jsonrpc_mstream_getbuf(response) == NULL
+		, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, id)
+	);
+	return jsonrpc_mstream_getbuf(response);
+}
+
+/**
+ * parse a batch element of a split batch in 'ctx' and execute it.
+ * the tree only lives while the element runs.
+ */
+JSONRPC_PRIVATE const char * execute_text (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx, const char *text, size_t length)
+{
+	jsonrpc_handle_t	request;
+	jsonrpc_arena_t		*arena = NULL;
+	jsonrpc_arena_mark_t	mark;
+	const char			*response;
+	char				*buf;
+	size_t				refused = jsonrpc_meter_read(&self->meter.refused);
+
+	JSONRPC_THROW((buf = get_temp_buf(ctx, length + 1)) == NULL
+		, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, &s_null_id)
+	);
+	memcpy(buf, text, length);
+	buf[length] = '\0';
+	JSONRPC_THROW(!check_utf8(self, buf, length)
+		, return get_error_object(ctx, JSONRPC_ERROR_PARSE_ERROR, &s_null_id)
 	);
 
-	jsonrpc_mstream_print(response, "{");
+	if (JSONRPC_JSONAPI(self)->parse_insitu)
+	{
+		JSONRPC_THROW((arena = get_arena(ctx)) == NULL
+			, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, &s_null_id)
+		);
+		mark    = jsonrpc_arena_mark(arena);
+		request = JSONRPC_JSONAPI(self)->parse_insitu(buf, length, arena);
+	}
+	else
+		request = JSONRPC_JSONAPI(self)->parse(buf);
+	JSONRPC_THROW(request == NULL, {
+		if (arena)
+			jsonrpc_arena_rewind(arena, mark);
+		return get_error_object(ctx, parse_error(self, refused), &s_null_id);
+	});
+
+	response = execute_request(self, ctx, request, NULL);
+	JSONRPC_JSONAPI(self)->release(request);
+	if (arena)	// the element is done: its memory goes back to the request
+		jsonrpc_arena_rewind(arena, mark);
+	return response;
+}
+
+JSONRPC_PRIVATE const char * execute_item (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx, const jsonrpc_batch_item_t *item)
+{
+	if (item->text)
+		return execute_text(self, ctx, item->text, item->length);
+	if (item->json)
+		return execute_request(self, ctx, item->json, NULL);
+	return get_error_object(ctx, JSONRPC_ERROR_INVALID_REQUEST, NULL);
+}
+
+JSONRPC_PRIVATE size_t	batch_alloc_size (size_t alloc, size_t n)
+{
+	for (alloc = alloc ? alloc : 16 ; alloc < n ; alloc *= 2)
+		;
+	return alloc;
+}
+
+#ifdef JSONRPC_HAVE_PTHREAD
+/**
+ * grow the per-element state of the worker pool to 'n' elements
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t	reserve_batch_slots (jsonrpc_server_t *self, size_t n)
+{
+	jsonrpc_mstream_t	**slots;
+	jsonrpc_bool_t		*ready;
+	size_t				*done;
+	size_t				i, alloc;
+
+	if (n <= self->batch.alloc)
+		return JSONRPC_TRUE;
+
+	alloc = batch_alloc_size(self->batch.alloc, n);
+	done = (size_t *)jsonrpc_realloc(self->batch.done, alloc * sizeof(size_t));
+	JSONRPC_THROW(done == NULL, return JSONRPC_FALSE);
+	self->batch.done = done;
+	ready = (jsonrpc_bool_t *)jsonrpc_realloc(self->batch.ready, alloc * sizeof(jsonrpc_bool_t));
+	JSONRPC_THROW(ready == NULL, return JSONRPC_FALSE);
+	self->batch.ready = ready;
+	slots = (jsonrpc_mstream_t **)jsonrpc_realloc(self->batch.slots, alloc * sizeof(jsonrpc_mstream_t *));
+	JSONRPC_THROW(slots == NULL, return JSONRPC_FALSE);
+	self->batch.slots = slots;
+
+	for (i = self->batch.alloc ; i < alloc ; i++)
+	{
+		JSONRPC_THROW((slots[i] = jsonrpc_mstream_open()) == NULL, {
+			self->batch.alloc = i;	// keep the streams opened so far
+			return JSONRPC_FALSE;
+		});
+	}
+	self->batch.alloc = alloc;
+	return JSONRPC_TRUE;
+}
+#endif
+
+JSONRPC_PRIVATE jsonrpc_bool_t	reserve_batch (jsonrpc_exec_ctx_t *ctx, size_t n)
+{
+	jsonrpc_batch_item_t	*items;
+	size_t				alloc;
+
+	if (n <= ctx->batch.alloc)
+		return JSONRPC_TRUE;
+
+	alloc = batch_alloc_size(ctx->batch.alloc, n);
+	items = (jsonrpc_batch_item_t *)jsonrpc_realloc(ctx->batch.items, alloc * sizeof(jsonrpc_batch_item_t));
+	JSONRPC_THROW(items == NULL, return JSONRPC_FALSE);
+	ctx->batch.items = items;
+	ctx->batch.alloc = alloc;
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t	reserve_iov (jsonrpc_exec_ctx_t *ctx, size_t n)
+{
+	jsonrpc_iovec_t		*list;
+	size_t				alloc;
+
+	if (n <= ctx->iov.alloc)
+		return JSONRPC_TRUE;
+
+	alloc = batch_alloc_size(ctx->iov.alloc, n);
+	list  = (jsonrpc_iovec_t *)jsonrpc_realloc(ctx->iov.list, alloc * sizeof(jsonrpc_iovec_t));
+	JSONRPC_THROW(list == NULL, return JSONRPC_FALSE);
+	ctx->iov.list  = list;
+	ctx->iov.alloc = alloc;
+	return JSONRPC_TRUE;
+}
+
+/**
+ * size the scratch memory of 'ctx' for the requests within the limits of its server
+ */
+JSONRPC_PRIVATE jsonrpc_bool_t	preallocate_ctx (jsonrpc_exec_ctx_t *ctx)
+{
+	const jsonrpc_limits_t	*limits = &ctx->server->steady.limits;
+	jsonrpc_mstream_t	*stream;
+	jsonrpc_arena_t		*arena;
+	size_t	i;
+
+	for (i = 0 ; i < JSONRPC_MEMSTREAM_NUM ; i++)	// every stream of the ring in turn
+	{
+		JSONRPC_THROW((stream = get_memstream(ctx, JSONRPC_TRUE)) == NULL, return JSONRPC_FALSE);
+		JSONRPC_THROW(jsonrpc_mstream_reserve(stream, limits->response) == NULL, return JSONRPC_FALSE);
+	}
+	JSONRPC_THROW(get_temp_param(ctx, limits->params) == NULL || !get_temp_named(ctx, limits->params), return JSONRPC_FALSE);
+	JSONRPC_THROW(get_temp_buf(ctx, limits->request + 1) == NULL, return JSONRPC_FALSE);
+	JSONRPC_THROW((arena = get_arena(ctx)) == NULL, return JSONRPC_FALSE);
+	JSONRPC_THROW(!jsonrpc_arena_reserve(arena, limits->request * JSONRPC_ARENA_PER_BYTE), return JSONRPC_FALSE);
+	JSONRPC_THROW(!reserve_batch(ctx, limits->batch), return JSONRPC_FALSE);
+	JSONRPC_THROW(!reserve_iov(ctx, limits->batch * 2 + 1), return JSONRPC_FALSE);	// "[" or "," before each response, "]"
+
+	if (ctx->output.stream == NULL)	// attached to the buffer of the caller from the start
+	{
+		JSONRPC_THROW((ctx->output.stream = jsonrpc_mstream_open()) == NULL, return JSONRPC_FALSE);
+		jsonrpc_mstream_attach(ctx->output.stream, NULL, 0, NULL, NULL);
+	}
+	return JSONRPC_TRUE;
+}
+
+/**
+ * size a scratch buffer is trimmed down to: the threshold, but not below
+ * twice (what growing by doubling may have taken) its preallocated size
+ */
+JSONRPC_PRIVATE size_t	trim_size (jsonrpc_server_t *server, size_t steady)
+{
+	steady = server->steady.on ? 2 * steady : 0;
+	return (server->memory.trim > steady) ? server->memory.trim : steady;
+}
+
+/**
+ * add the bytes of each class of scratch memory held by 'ctx' to 'bytes'
+ */
+JSONRPC_PRIVATE void	measure_ctx (jsonrpc_exec_ctx_t *ctx, size_t *bytes)
+{
+	size_t	i;
+
+	for (i = 0 ; i < JSONRPC_MEMSTREAM_NUM ; i++)
+	{
+		if (ctx->stream.mstream[i])
+			bytes[JSONRPC_MEMORY_STREAMS] += jsonrpc_mstream_capacity(ctx->stream.mstream[i]);
+	}
+	bytes[JSONRPC_MEMORY_TEXT]   += ctx->text.size;
+	bytes[JSONRPC_MEMORY_PARAMS] += ctx->param.argc * sizeof(jsonrpc_param_t) + ctx->named.size * (sizeof(jsonrpc_param_t) + sizeof(size_t));
+	if (ctx->arena)
+		bytes[JSONRPC_MEMORY_ARENA] += jsonrpc_arena_capacity(ctx->arena);
+	bytes[JSONRPC_MEMORY_BATCH]  += ctx->batch.alloc * sizeof(jsonrpc_batch_item_t) + ctx->iov.alloc * sizeof(jsonrpc_iovec_t);
+}
+
+/**
+ * scratch memory of the server: its own context, and the contexts and slots of its batch workers
+ */
+JSONRPC_PRIVATE void	measure_server (jsonrpc_server_t *self, size_t *bytes)
+{
+#ifdef JSONRPC_HAVE_PTHREAD
+	size_t	i;
+#endif
+
+	memset(bytes, 0, JSONRPC_MEMORY_CLASSES * sizeof(size_t));
+	measure_ctx(&self->ctx, bytes);
+#ifdef JSONRPC_HAVE_PTHREAD
+	for (i = 0 ; i < self->batch.threads ; i++)
+		measure_ctx(&self->batch.workers[i].ctx, bytes);
+	for (i = 0 ; i < self->batch.alloc ; i++)
+		bytes[JSONRPC_MEMORY_STREAMS] += jsonrpc_mstream_capacity(self->batch.slots[i]);
+	bytes[JSONRPC_MEMORY_BATCH] += self->batch.alloc * (sizeof(jsonrpc_mstream_t *) + sizeof(jsonrpc_bool_t) + sizeof(size_t));
+#endif
+}
+
+/**
+ * give back the scratch memory of 'ctx' beyond the trim threshold of its server
+ * (the buffers are left as they are when they cannot be shrunk)
+ */
+JSONRPC_PRIVATE void	trim_ctx (jsonrpc_exec_ctx_t *ctx)
+{
+	jsonrpc_server_t	*server = ctx->server;
+	const jsonrpc_limits_t	*limits = &server->steady.limits;
+	jsonrpc_param_t		*argv;
+	char	*buf;
+	size_t	i, size;
+
+	for (i = 0 ; i < JSONRPC_MEMSTREAM_NUM ; i++)
+	{
+		if (ctx->stream.mstream[i] && !ctx->stream.used[i])
+			jsonrpc_mstream_trim(ctx->stream.mstream[i], trim_size(server, limits->response + 1));
+	}
+
+	size = trim_size(server, limits->request + 1);
+	if (ctx->text.size > size && (buf = (char *)jsonrpc_realloc(ctx->text.buf, size)) != NULL)
+	{
+		ctx->text.buf  = buf;
+		ctx->text.size = size;
+	}
+
+	size = trim_size(server, limits->params * sizeof(jsonrpc_param_t)) / sizeof(jsonrpc_param_t);
+	if (size < 16)	// default argc
+		size = 16;
+	if (ctx->param.argc > size && (argv = (jsonrpc_param_t *)jsonrpc_realloc(ctx->param.argv, size * sizeof(jsonrpc_param_t))) != NULL)
+	{
+		ctx->param.argv = argv;
+		ctx->param.argc = size;
+	}
+	if (ctx->named.size * (sizeof(jsonrpc_param_t) + sizeof(size_t)) > trim_size(server, limits->params * (sizeof(jsonrpc_param_t) + sizeof(size_t))))
+	{
+		jsonrpc_vfree(ctx->named.argv, ctx->named.hash, NULL);
+		ctx->named.argv = NULL;
+		ctx->named.hash = NULL;
+		ctx->named.size = 0;
+	}
+
+	if (ctx->arena)
+		jsonrpc_arena_trim(ctx->arena, trim_size(server, limits->request * JSONRPC_ARENA_PER_BYTE));
+
+	if (ctx->batch.alloc * sizeof(jsonrpc_batch_item_t) > trim_size(server, limits->batch * sizeof(jsonrpc_batch_item_t)))
+	{
+		jsonrpc_free(ctx->batch.items);
+		ctx->batch.items = NULL;
+		ctx->batch.alloc = 0;
+	}
+	if (ctx->iov.alloc * sizeof(jsonrpc_iovec_t) > trim_size(server, (limits->batch * 2 + 1) * sizeof(jsonrpc_iovec_t)))
+	{
+		jsonrpc_free(ctx->iov.list);
+		ctx->iov.list  = NULL;
+		ctx->iov.alloc = 0;
+	}
+}
+
+/**
+ * make 'ctx' ready for the next request: the memory of the last one goes at once.
+ * the scratch memory of the server is accounted (its batch workers are idle between
+ * its requests), and the buffers grown by the last request are trimmed.
+ */
+JSONRPC_PRIVATE void	recycle_ctx (jsonrpc_exec_ctx_t *ctx)
+{
+	jsonrpc_server_t	*server = ctx->server;
+	size_t	bytes[JSONRPC_MEMORY_CLASSES];
+	size_t	i;
+
+	if (ctx == &server->ctx)
 	{
-		jsonrpc_mstream_print(response, "\"jsonrpc\":\"%s\"", JSONRPC_VERSION);
-		jsonrpc_mstream_print(response, ",\"result\":%s", jsonrpc_mstream_getbuf(result));
-		if (id->type == JSONRPC_TYPE_NUMBER)
-			jsonrpc_mstream_print(response, ",\"id\":%.0lf", id->u.number);
-		else if (id->type == JSONRPC_TYPE_STRING)
-			jsonrpc_mstream_print(response, ",\"id\":\"%s\"", id->u.string);
+		measure_server(server, bytes);
+		for (i = 0 ; i < JSONRPC_MEMORY_CLASSES ; i++)
+		{
+			if (server->memory.peak[i] < bytes[i])
+				server->memory.peak[i] = bytes[i];
+		}
+	}
+
+	if (server->memory.trim > 0)
+		trim_ctx(ctx);
+	else if (ctx->arena)
+		jsonrpc_arena_reset(ctx->arena);
+#ifdef JSONRPC_HAVE_PTHREAD
+	if (ctx == &server->ctx)	// the workers have the scratch memory of the methods they ran
+	{
+		for (i = 0 ; i < server->batch.threads ; i++)
+		{
+			if (server->memory.trim > 0)
+				trim_ctx(&server->batch.workers[i].ctx);
+			else if (server->batch.workers[i].ctx.arena)
+				jsonrpc_arena_reset(server->batch.workers[i].ctx.arena);
+		}
+		for (i = 0 ; i < server->batch.alloc && server->memory.trim > 0 ; i++)
+			jsonrpc_mstream_trim(server->batch.slots[i], trim_size(server, server->steady.limits.response + 1));
+	}
+#endif
+}
+
+/**
+ * find the elements of a batch in the raw text, without parsing them.
+ *
+ * @return number of elements, or 0 with 'error' set
+ */
+JSONRPC_PRIVATE size_t	split_batch (jsonrpc_exec_ctx_t *ctx, const char *data, size_t length, jsonrpc_error_t *error)
+{
+	const char	*p, *end = data + length;
+	size_t		n = 0;
+
+	*error = JSONRPC_ERROR_PARSE_ERROR;
+	for (p = data ; p < end && isspace((unsigned char)*p) ; p++)
+		;
+	JSONRPC_THROW(p == end || *p != '[', return 0);
+	for (p++ ; p < end && isspace((unsigned char)*p) ; p++)
+		;
+	JSONRPC_THROW(p < end && *p == ']', {
+		*error = JSONRPC_ERROR_INVALID_REQUEST;	// empty batch
+		return 0;
+	});
+
+	for (;;)
+	{
+		JSONRPC_THROW(!reserve_batch(ctx, n + 1), {
+			*error = JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
+			return 0;
+		});
+		ctx->batch.items[n].json = NULL;
+		ctx->batch.items[n].text = p;
+		JSONRPC_THROW((p = jsonrpc_string_skip_value(p, end)) == NULL, return 0);
+		ctx->batch.items[n].length = (size_t)(p - ctx->batch.items[n].text);
+		n++;
+
+		for ( ; p < end && isspace((unsigned char)*p) ; p++)
+			;
+		JSONRPC_THROW(p == end, return 0);
+		if (*p++ == ']')
+			break;
+		JSONRPC_THROW(p[-1] != ',', return 0);
+		for ( ; p < end && isspace((unsigned char)*p) ; p++)
+			;
+	}
+
+	for ( ; p < end && isspace((unsigned char)*p) ; p++)
+		;
+	JSONRPC_THROW(p != end, return 0);	// trailing garbage
+	return n;
+}
+
+/**
+ * hand one element response of a batch to the emitter ("[" before the first one)
+ */
+JSONRPC_PRIVATE void	emit_response (jsonrpc_emitter_t *emitter, const char *response, size_t length)
+{
+	if (emitter->error != JSONRPC_ERROR_OK)
+		return;
+	emitter->error = emitter->write(emitter->ctx, emitter->count ? "," : "[", 1, JSONRPC_TRUE);
+	if (emitter->error == JSONRPC_ERROR_OK)
+		emitter->error = emitter->write(emitter->ctx, response, length, JSONRPC_TRUE);
+	emitter->count++;
+}
+
+/**
+ * append an element response to the "[...]" response of a batch ('c' responses so far)
+ */
+JSONRPC_PRIVATE int	append_response (jsonrpc_mstream_t *resbuf, size_t c, const char *response, size_t length)
+{
+	JSONRPC_THROW(c > 0 && jsonrpc_mstream_write(resbuf, ",", 1) < 0, return -1);
+	return jsonrpc_mstream_write(resbuf, response, length);
+}
+
+#ifdef JSONRPC_HAVE_PTHREAD
+/**
+ * run elements of the posted batch until none is left.
+ * each response is copied into the element's slot, as 'ctx' reuses its streams.
+ */
+JSONRPC_PRIVATE void	run_batch (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx)
+{
+	jsonrpc_mstream_t	*slot;
+	const char			*response;
+	size_t				i;
+	jsonrpc_bool_t		failed;
+
+	pthread_mutex_lock(&self->batch.lock);
+	while (self->batch.next < self->batch.count)
+	{
+		i = self->batch.next++;
+		pthread_mutex_unlock(&self->batch.lock);
+
+		slot = self->batch.slots[i];
+		jsonrpc_mstream_rewind(slot);
+		response = execute_item(self, ctx, self->ctx.batch.items + i);
+		failed   = (response && jsonrpc_mstream_write(slot, response, strlen(response)) < 0);
+		if (failed)
+			jsonrpc_mstream_rewind(slot);	// dropped rather than cut short
+
+		pthread_mutex_lock(&self->batch.lock);
+		if (failed)
+			self->batch.failed = JSONRPC_TRUE;
+		self->batch.ready[i] = JSONRPC_TRUE;
+		self->batch.done[self->batch.finished++] = i;
+		pthread_cond_signal(&self->batch.finish);	// the calling thread waits for the last one, or streams each one
+	}
+	pthread_mutex_unlock(&self->batch.lock);
+}
+
+JSONRPC_PRIVATE void *	batch_worker (void *arg)
+{
+	jsonrpc_worker_t	*worker = (jsonrpc_worker_t *)arg;
+	jsonrpc_server_t	*self   = worker->server;
+
+	pthread_mutex_lock(&self->batch.lock);
+	while (!self->batch.quit)
+	{
+		if (self->batch.next < self->batch.count)
+		{
+			pthread_mutex_unlock(&self->batch.lock);
+			jsonrpc_set_thread_allocator(JSONRPC_SERVING_ALLOCATOR(self));	// the server may have gone into steady state
+			run_batch(self, &worker->ctx);
+			pthread_mutex_lock(&self->batch.lock);
+			continue;
+		}
+		pthread_cond_wait(&self->batch.wake, &self->batch.lock);
+	}
+	pthread_mutex_unlock(&self->batch.lock);
+	return NULL;
+}
+
+JSONRPC_PRIVATE void	stop_batch_workers (jsonrpc_server_t *self)
+{
+	size_t	i;
+
+	if (self->batch.workers == NULL)
+		return;
+
+	pthread_mutex_lock(&self->batch.lock);
+	self->batch.quit = JSONRPC_TRUE;
+	pthread_cond_broadcast(&self->batch.wake);
+	pthread_mutex_unlock(&self->batch.lock);
+
+	for (i = 0 ; i < self->batch.threads ; i++)
+	{
+		pthread_join(self->batch.workers[i].thread, NULL);
+		clear_exec_ctx(&self->batch.workers[i].ctx);
+	}
+	jsonrpc_free(self->batch.workers);
+	self->batch.workers = NULL;
+	self->batch.threads = 0;
+	self->batch.quit    = JSONRPC_FALSE;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t	start_batch_workers (jsonrpc_server_t *self, size_t threads)
+{
+	size_t	i;
+
+	stop_batch_workers(self);
+	if (threads == 0)
+		return JSONRPC_TRUE;
+
+	self->batch.workers = (jsonrpc_worker_t *)jsonrpc_calloc(threads, sizeof(jsonrpc_worker_t));
+	JSONRPC_THROW(self->batch.workers == NULL, return JSONRPC_FALSE);
+
+	for (i = 0 ; i < threads ; i++)
+	{
+		self->batch.workers[i].server     = self;
+		self->batch.workers[i].ctx.server = self;
+		JSONRPC_THROW(pthread_create(&self->batch.workers[i].thread, NULL, batch_worker, self->batch.workers + i) != 0, {
+			self->batch.threads = i;
+			stop_batch_workers(self);
+			return JSONRPC_FALSE;
+		});
+	}
+	self->batch.threads = threads;
+	return JSONRPC_TRUE;
+}
+
+/**
+ * run the 'n' elements of 'ctx.batch.items' on the workers, and on the calling thread
+ * unless it streams the responses to 'emitter' as they finish. otherwise the
+ * responses are appended to 'resbuf' at the end.
+ * either way, they are in request or completion order.
+ * a response that did not fit in memory is left out, and sets 'batch.failed'.
+ *
+ * @return number of responses
+ */
+JSONRPC_PRIVATE size_t	execute_batch_parallel (jsonrpc_server_t *self, size_t n, jsonrpc_mstream_t *resbuf, jsonrpc_emitter_t *emitter)
+{
+	jsonrpc_mstream_t	*slot;
+	size_t	i, k, c;
+	int		ret = 0;
+
+	pthread_mutex_lock(&self->batch.lock);
+	memset(self->batch.ready, 0, n * sizeof(jsonrpc_bool_t));
+	self->batch.count    = n;
+	self->batch.next     = 0;
+	self->batch.finished = 0;
+	self->batch.failed   = JSONRPC_FALSE;
+	pthread_cond_broadcast(&self->batch.wake);
+	pthread_mutex_unlock(&self->batch.lock);
+
+	if (emitter == NULL || emitter->borrow)	// nothing to stream: help the workers
+		run_batch(self, &self->ctx);
+
+	pthread_mutex_lock(&self->batch.lock);
+	for (k = 0, c = 0 ; k < n ; k++)
+	{
+		// wait for the k-th response in the chosen order (all are done already unless streaming)
+		while (self->batch.order == JSONRPC_BATCH_ORDER_COMPLETION ? k >= self->batch.finished : !self->batch.ready[k])
+			pthread_cond_wait(&self->batch.finish, &self->batch.lock);
+		pthread_mutex_unlock(&self->batch.lock);
+
+		i    = (self->batch.order == JSONRPC_BATCH_ORDER_COMPLETION) ? self->batch.done[k] : k;
+		slot = self->batch.slots[i];
+		if (jsonrpc_mstream_length(slot) > 0)	// not a notification
+		{
+			if (emitter)
+				emit_response(emitter, jsonrpc_mstream_getbuf(slot), jsonrpc_mstream_length(slot));
+			else
+				ret |= append_response(resbuf, c, jsonrpc_mstream_getbuf(slot), jsonrpc_mstream_length(slot));
+			c++;
+		}
+		pthread_mutex_lock(&self->batch.lock);
+	}
+	if (ret < 0)
+		self->batch.failed = JSONRPC_TRUE;
+	self->batch.count = 0;
+	self->batch.next  = 0;
+	pthread_mutex_unlock(&self->batch.lock);
+	return c;
+}
+#endif
+
+/**
+ * execute the 'n' elements of 'ctx->batch.items' and write the "[...]" response,
+ * or hand each element response to 'emitter' as soon as it is done.
+ * only the batches of the server's own context go to the workers.
+ * a borrowing emitter only gets the responses kept in the slots of the workers;
+ * without workers, the response is written out as usual.
+ *
+ * @return the response (NULL if streamed or there is nothing to respond)
+ */
+JSONRPC_PRIVATE const char * execute_batch (jsonrpc_server_t *self, jsonrpc_exec_ctx_t *ctx, size_t n, jsonrpc_emitter_t *emitter)
+{
+	jsonrpc_mstream_t	*resbuf = NULL;
+	const char			*response;
+	size_t				i, c;
+	jsonrpc_bool_t		parallel = JSONRPC_FALSE;
+	jsonrpc_bool_t		failed   = JSONRPC_FALSE;
+	int					ret = 0;
+
+#ifdef JSONRPC_HAVE_PTHREAD
+	parallel = self->batch.threads > 0 && n > 1 && ctx == &self->ctx && reserve_batch_slots(self, n);
+#endif
+	if (emitter && emitter->borrow && !parallel)
+		emitter = NULL;	// the responses in 'ctx' do not outlive the next element
+
+	if (emitter == NULL && ctx->output.active)
+	{
+		resbuf = ctx->output.stream;
+		jsonrpc_mstream_rewind(resbuf);
+		ret = jsonrpc_mstream_write(resbuf, "[", 1);
+	}
+	else if (emitter == NULL)
+	{
+		JSONRPC_THROW((resbuf = get_memstream(ctx, JSONRPC_FALSE)) == NULL
+			, return get_error_object(ctx, JSONRPC_ERROR_SERVER_INTERNAL, NULL)
+		);
+		ret = jsonrpc_mstream_write(resbuf, "[", 1);
+	}
+
+#ifdef JSONRPC_HAVE_PTHREAD
+	if (parallel)
+	{
+		c = execute_batch_parallel(self, n, resbuf, emitter);
+		failed = self->batch.failed;
+	}
+	else
+#endif
+	for (i = 0, c = 0 ; i < n ; i++)
+	{
+		response = execute_item(self, ctx, ctx->batch.items + i);
+		if (response == NULL)
+			continue;
+
+		if (emitter)
+			emit_response(emitter, response, strlen(response));
 		else
-			jsonrpc_mstream_print(response, ",\"id\":null");
+			ret |= append_response(resbuf, c, response, strlen(response));
+		c++;
 	}
-	jsonrpc_mstream_print(response, "}");
 
-	return jsonrpc_mstream_getbuf(response);
+	if (emitter)
+	{
+		if (c > 0 && emitter->error == JSONRPC_ERROR_OK)
+			emitter->error = emitter->write(emitter->ctx, "]", 1, JSONRPC_FALSE);
+		return NULL;
+	}
+	ret |= jsonrpc_mstream_write(resbuf, "]", 1);
+	if (resbuf != ctx->output.stream)
+		release_memstream(ctx, resbuf);
+	JSONRPC_THROW(ret < 0 || failed || (c > 0 && jsonrpc_mstream_getbuf(resbuf) == NULL)
+		, return get_error_object(ctx, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY, &s_null_id)
+	);
+	return (c > 0) ? jsonrpc_mstream_getbuf(resbuf) : NULL;
+}
+
+/**
+ * output of a response as pieces in place ('ctx' is the execution context)
+ */
+JSONRPC_PRIVATE jsonrpc_error_t add_iovec (void *ctx, const char *data, size_t length, jsonrpc_bool_t more)
+{
+	jsonrpc_exec_ctx_t	*self = (jsonrpc_exec_ctx_t *)ctx;
+
+	(void)more;
+	JSONRPC_THROW(!reserve_iov(self, self->iov.count + 1), return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+	self->iov.list[self->iov.count].base   = data;
+	self->iov.list[self->iov.count].length = length;
+	self->iov.count++;
+	return JSONRPC_ERROR_OK;
 }
 
-JSONRPC_PRIVATE const char * execute (jsonrpc_server_t *self, const char *data)
+/**
+ * execute a request. with 'emitter', the response of a batch is streamed
+ * instead of returned.
+ */
+JSONRPC_PRIVATE const char * execute (jsonrpc_exec_ctx_t *ctx, const char *data, jsonrpc_emitter_t *emitter)
 {
+	jsonrpc_server_t	*self = ctx->server;
 	jsonrpc_handle_t	request;
-	jsonrpc_handle_t	value;
 	jsonrpc_error_t		error;
-	jsonrpc_mstream_t	*resbuf;
-	const char *		response;
-	const jsonrpc_json_t	*json_value;
+	const char *		response = NULL;
+	jsonrpc_json_t		*json_value;
+	size_t				i, n, length;
+	size_t				refused = jsonrpc_meter_read(&self->meter.refused);
+
+	recycle_ctx(ctx);	// whatever the previous request allocated goes at once
 
-	error = JSONRPC_ERROR_OK;
-	JSONRPC_THROW(!(request = JSONRPC_JSONAPI(self)->parse(data)), {
-		error = JSONRPC_ERROR_PARSE_ERROR;
+	error  = JSONRPC_ERROR_OK;
+	length = strlen(data);
+	if (self->batch.split > 0 && length >= self->batch.split)
+	{
+		// a big batch is cut into elements first, so they are parsed one by one (in parallel with workers)
+		for (i = 0 ; isspace((unsigned char)data[i]) ; i++)
+			;
+		if (data[i] == '[')
+		{
+			JSONRPC_THROW((n = split_batch(ctx, data, length, &error)) == 0
+				, return get_error_object(ctx, error, (error == JSONRPC_ERROR_SERVER_OUT_OF_MEMORY) ? &s_null_id : NULL)
+			);
+			return execute_batch(self, ctx, n, emitter);
+		}
+	}
+
+	JSONRPC_THROW(!(request = parse_json(self, ctx, data, length)), {
+		error = parse_error(self, refused);
 		goto RESPONSE;
 	});
-	json_value = get_temp_value(self);
-	JSONRPC_THROW(!JSONRPC_JSONAPI(self)->valueof(request, json_value), {
+	json_value = get_temp_value(ctx);
+	JSONRPC_THROW(!get_value(self, request, json_value), {
 		error = JSONRPC_ERROR_SERVER_INTERNAL;
 		goto RESPONSE;
 	});
-	JSONRPC_THROW(json_value->type != JSONRPC_TYPE_OBJECT, {
+	JSONRPC_THROW(json_value->type != JSONRPC_TYPE_OBJECT && json_value->type != JSONRPC_TYPE_ARRAY, {
 		error = JSONRPC_ERROR_INVALID_REQUEST;
 		goto RESPONSE;
 	});
 
-	if ((json_value = get_json_value(self, request, "batch", "a")) != NULL)	// batch
+	if (json_value->type == JSONRPC_TYPE_ARRAY)	// batch: the elements are executed where the plug-in parsed them
 	{
-		size_t	i, c, n;
-		jsonrpc_handle_t batch = json_value->u.array;
-
-		JSONRPC_THROW((n = JSONRPC_JSONAPI(self)->length(batch)) == 0, {
+		JSONRPC_THROW((n = JSONRPC_JSONAPI(self)->length(json_value->u.array)) == 0, {
 			error = JSONRPC_ERROR_INVALID_REQUEST;
 			goto RESPONSE;
 		});
-		JSONRPC_THROW((resbuf = get_memstream(self, JSONRPC_FALSE)) == NULL, {
-			error = JSONRPC_ERROR_SERVER_INTERNAL;
+		JSONRPC_THROW(!reserve_batch(ctx, n), {
+			error = JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
 			goto RESPONSE;
 		});
 
-		jsonrpc_mstream_print(resbuf, "[");
-		for (i = 0, c = 0 ; i < n ; i++)
+		// handles are taken up front: 'get_at' of a plug-in may update a cache in the array
+		for (i = 0 ; i < n ; i++)
 		{
-			value = JSONRPC_JSONAPI(self)->get_at(batch, i);
-			if (!value)
-				response = get_error_object(self, JSONRPC_ERROR_INVALID_REQUEST, NULL);
-			else
-				response = execute_request(self, value);
-
-			if (response)
-			{
-				if (c > 0)
-					jsonrpc_mstream_print(resbuf, ",");
-				jsonrpc_mstream_print(resbuf, response);
-				c++;
-			}
+			ctx->batch.items[i].json = JSONRPC_JSONAPI(self)->get_at(json_value->u.array, i);
+			ctx->batch.items[i].text = NULL;
 		}
-		jsonrpc_mstream_print(resbuf, "]");
-		if (c == 0)
-			response = NULL;
-		else response = jsonrpc_mstream_getbuf(resbuf);
-
-		release_memstream(self, resbuf);
+		response = execute_batch(self, ctx, n, emitter);
 	}
-	else //if (json_value->type == JSONRPC_TYPE_OBJECT)
+	else
 	{
-		response = execute_request(self, request);
+		response = execute_request(self, ctx, request, ctx->output.active ? ctx->output.stream : NULL);
 	}
 
 RESPONSE:
 	if (request)
 		JSONRPC_JSONAPI(self)->release(request);
 	if (error != JSONRPC_ERROR_OK)
-		return get_error_object(self, error, NULL);
+		return get_error_object(ctx, error, (error == JSONRPC_ERROR_SERVER_OUT_OF_MEMORY) ? &s_null_id : NULL);
 	return response;
 }
 
 
 
-jsonrpc_server_t *
-jsonrpc_server_open (const jsonrpc_json_plugin_t *ijson, const jsonrpc_net_plugin_t *inet, ...)
+JSONRPC_PRIVATE void close_server (jsonrpc_server_t *self)
+{
+	size_t	i, j;
+
+	if (self->net_handle)
+		self->net.close(self->net_handle);
+
+#ifdef JSONRPC_HAVE_PTHREAD
+	stop_batch_workers(self);
+	for (i = 0 ; i < self->batch.alloc ; i++)
+		jsonrpc_mstream_close(self->batch.slots[i]);
+	if (self->batch.slots)
+		jsonrpc_free(self->batch.slots);
+	if (self->batch.done)
+		jsonrpc_free(self->batch.done);
+	if (self->batch.ready)
+		jsonrpc_free(self->batch.ready);
+	pthread_cond_destroy(&self->batch.finish);
+	pthread_cond_destroy(&self->batch.wake);
+	pthread_mutex_destroy(&self->batch.lock);
+#endif
+	clear_exec_ctx(&self->ctx);
+
+	if (self->proc.table)
+	{
+		for (i = 0 ; i < self->proc.size ; i++)
+		{
+			jsonrpc_proc_group_t *group = self->proc.table + i;
+
+			for (j = 0 ; j < group->count ; j++)
+			{
+				if (group->list[j]->argv)
+					jsonrpc_free(group->list[j]->argv);
+				if (group->list[j]->types)
+					jsonrpc_free(group->list[j]->types);
+				if (group->list[j]->names)
+					jsonrpc_free(group->list[j]->names);
+				jsonrpc_free(group->list[j]);
+			}
+			if (group->list)
+				jsonrpc_free(group->list);
+			if (group->index)
+				jsonrpc_free(group->index);
+		}
+		jsonrpc_free(self->proc.table);
+	}
+}
+
+JSONRPC_PRIVATE jsonrpc_server_t * open_server (const jsonrpc_json_plugin_t *ijson, const jsonrpc_net_plugin_t *inet, va_list ap)
 {
 	jsonrpc_server_t	*self;
+	jsonrpc_bool_t		ok;
 
 	JSONRPC_THROW(
-		check_null_func((void *)ijson, sizeof(jsonrpc_json_plugin_t)) != 0
-		&& (inet == NULL || (inet && check_null_func((void *)inet, sizeof(jsonrpc_net_plugin_t)) != 0))
+		check_null_func((void *)ijson, offsetof(jsonrpc_json_plugin_t, get_members)/* required funcs */) != 0
+		&& (inet == NULL || (inet && check_null_func((void *)inet, offsetof(jsonrpc_net_plugin_t, send_partial)) != 0))
 		, return NULL
 	);
 
+	// the server itself comes from the allocator of the thread, and all the rest through its meter
 	self = (jsonrpc_server_t *)jsonrpc_calloc(1, sizeof(jsonrpc_server_t));
 	JSONRPC_THROW(self == NULL, return NULL);
-	JSONRPC_THROW(get_temp_param(self, 16/* default argc */) == NULL, goto ERROR);
+	self->ctx.server = self;
+#ifdef JSONRPC_HAVE_PTHREAD
+	pthread_mutex_init(&self->batch.lock, NULL);
+	pthread_cond_init(&self->batch.wake, NULL);
+	pthread_cond_init(&self->batch.finish, NULL);
+#endif
 
 	memcpy(&self->json, ijson, sizeof(jsonrpc_json_plugin_t));
+	jsonrpc_meter_init(&self->meter, jsonrpc_allocator_current());
 	if (inet)
-	{
-		va_list	ap;
-		
 		memcpy(&self->net, inet, sizeof(jsonrpc_net_plugin_t));
-		
-		va_start(ap, inet);
-		self->net_handle = self->net.open(ap);
-		va_end(ap);
-		JSONRPC_THROW(!self->net_handle, goto ERROR);
-	}
-	return self;
-ERROR:
-	jsonrpc_server_close(self);
-	return NULL;
-}
-
-void
-jsonrpc_server_close (jsonrpc_server_t *self)
-{
-	size_t	i;
 
-	if (self->net_handle)
-		self->net.close(self->net_handle);
-	
-	for (i = 0 ; i < JSONRPC_MEMSTREAM_NUM ; i++)
-	{
-		if (self->stream.mstream[i])
-			jsonrpc_mstream_close(self->stream.mstream[i]);
-	}
-	if (self->param.argv)
-		jsonrpc_free(self->param.argv);
-	if (self->tempbuf.buf)
-		jsonrpc_free(self->tempbuf.buf);
-
-	if (self->proc.list)
-	{
-		for (i = 0 ; i < self->proc.count ; i++)
-		{
-			if (self->proc.list[i])
-			{
-				if (self->proc.list[i]->argv)
-					jsonrpc_free(self->proc.list[i]->argv);
-				jsonrpc_free(self->proc.list[i]);
-			}
-		}
-		jsonrpc_free(self->proc.list);
-	}
-	jsonrpc_free(self);
+	JSONRPC_WITH_ALLOCATOR(self, {
+		ok = get_temp_param(&self->ctx, 16/* default argc */) != NULL
+			&& (inet == NULL || (self->net_handle = self->net.open(ap)) != NULL);
+		if (!ok)
+			close_server(self);
+	});
+	JSONRPC_THROW(!ok, {
+		jsonrpc_free(self);	// back to the allocator of the thread
+		return NULL;
+	});
+	return self;
 }
 
-jsonrpc_error_t
-jsonrpc_server_register_method (
+JSONRPC_PRIVATE jsonrpc_error_t register_method (
 							jsonrpc_server_t *self
 							, jsonrpc_bool_t has_return
 							, jsonrpc_method_t method
@@ -796,6 +1947,7 @@ jsonrpc_server_register_method (
 						)
 {
 	jsonrpc_procedure_t	*proc;
+	jsonrpc_error_t	err = JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
 	int		ret;
 	size_t	size;
 
@@ -808,19 +1960,25 @@ jsonrpc_server_register_method (
 	proc->method = method;
 	proc->has_return = has_return;
 
-    for (size = self->param.argc ; get_temp_param(self, size) ; size *= 2)
+    for (size = self->ctx.param.argc ; get_temp_param(&self->ctx, size) ; size *= 2)
     {
-        ret = parse_param_signature(self, param_signature, (int)self->param.argc, self->param.argv);
-        JSONRPC_THROW(ret < 0, return JSONRPC_ERROR_INVALID_PARAMS);
+        ret = parse_param_signature(self, param_signature, (int)self->ctx.param.argc, self->ctx.param.argv);
+        JSONRPC_THROW(ret < 0, {
+			err = JSONRPC_ERROR_INVALID_PARAMS;
+			break;
+		});
 
-        if (ret <= (int)self->param.argc)
+        if (ret <= (int)self->ctx.param.argc)
         {
 			if (ret > 0)
 			{
-				proc->argv = (jsonrpc_param_t *)jsonrpc_memdup(self->param.argv, sizeof(jsonrpc_param_t) * (size_t)ret);
+				proc->argv = (jsonrpc_param_t *)jsonrpc_memdup(self->ctx.param.argv, sizeof(jsonrpc_param_t) * (size_t)ret);
 				JSONRPC_THROW(proc->argv == NULL, break);
 				proc->argc = (size_t)ret;
 			}
+			JSONRPC_THROW(!compile_param_types(proc), break);
+			JSONRPC_THROW((err = compile_param_names(proc)) != JSONRPC_ERROR_OK, break);
+			err = JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
 			JSONRPC_THROW(!add_procedure(self, proc), break);
 
 			return JSONRPC_ERROR_OK;
@@ -828,25 +1986,203 @@ jsonrpc_server_register_method (
     }
 	if (proc->argv)
 		jsonrpc_free(proc->argv);
+	if (proc->types)
+		jsonrpc_free(proc->types);
+	if (proc->names)
+		jsonrpc_free(proc->names);
 	jsonrpc_free(proc);
-	return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY;
+	return err;
 }
 
 
-const char *
-jsonrpc_server_execute (jsonrpc_server_t *self, const char *request)
+JSONRPC_PRIVATE jsonrpc_exec_ctx_t * open_exec_ctx (jsonrpc_server_t *server)
 {
-	if (str_startwith(request, '[')) // batch
+	jsonrpc_exec_ctx_t	*self;
+
+	self = (jsonrpc_exec_ctx_t *)jsonrpc_calloc(1, sizeof(jsonrpc_exec_ctx_t));
+	JSONRPC_THROW(self == NULL, return NULL);
+	self->server = server;
+	JSONRPC_THROW(get_temp_param(self, 16/* default argc */) == NULL || (server->steady.on && !preallocate_ctx(self)), {
+		clear_exec_ctx(self);
+		jsonrpc_free(self);
+		return NULL;
+	});
+	return self;
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t execute_stream (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_output_t output, void *ctx)
+{
+	jsonrpc_emitter_t	emitter;
+	const char			*response;
+
+	emitter.write  = output;
+	emitter.ctx    = ctx;
+	emitter.count  = 0;
+	emitter.error  = JSONRPC_ERROR_OK;
+	emitter.borrow = JSONRPC_FALSE;
+
+	response = execute(self, request, &emitter);
+	if (response)	// single response (or error of the whole batch)
+		return output(ctx, response, strlen(response), JSONRPC_FALSE);
+	return emitter.error;
+}
+
+JSONRPC_PRIVATE size_t execute_into (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_buffer_t *out)
+{
+	jsonrpc_mstream_t	*stream;
+	const char			*response;
+
+	if (self->output.stream == NULL)
 	{
-		request = make_batch_object(self, request);
-		if (request == NULL)
-			return NULL;
+		JSONRPC_THROW((self->output.stream = jsonrpc_mstream_open()) == NULL, return 0);
 	}
-	return execute(self, request);
+	stream = self->output.stream;
+	jsonrpc_mstream_attach(stream, out->buf, out->size, out->grow, out->ctx);
+
+	self->output.active = JSONRPC_TRUE;
+	response = execute(self, request, NULL);
+	self->output.active = JSONRPC_FALSE;
+	if (response == NULL)
+		return 0;
+
+	if (response != jsonrpc_mstream_getbuf(stream))	// error object
+	{
+		jsonrpc_mstream_rewind(stream);
+		JSONRPC_THROW(jsonrpc_mstream_write(stream, response, strlen(response)) < 0, return 0);
+	}
+	out->buf  = (char *)jsonrpc_mstream_getbuf(stream);
+	out->size = jsonrpc_mstream_capacity(stream);
+	return jsonrpc_mstream_length(stream);
 }
 
-jsonrpc_error_t
-jsonrpc_server_run (jsonrpc_server_t *self, unsigned int timeout)
+JSONRPC_PRIVATE size_t execute_iov (jsonrpc_exec_ctx_t *self, const char *request, const jsonrpc_iovec_t **iov)
+{
+	jsonrpc_emitter_t	emitter;
+	const char			*response;
+
+	emitter.write  = add_iovec;
+	emitter.ctx    = self;
+	emitter.count  = 0;
+	emitter.error  = JSONRPC_ERROR_OK;
+	emitter.borrow = JSONRPC_TRUE;
+
+	self->iov.count = 0;
+	response = execute(self, request, &emitter);
+	if (response)
+		add_iovec(self, response, strlen(response), JSONRPC_FALSE);
+	*iov = self->iov.list;
+	return (emitter.error == JSONRPC_ERROR_OK) ? self->iov.count : 0;
+}
+
+/**
+ * size the scratch memory of the server and its workers for 'steady.limits'
+ */
+JSONRPC_PRIVATE jsonrpc_error_t preallocate (jsonrpc_server_t *self)
+{
+#ifdef JSONRPC_HAVE_PTHREAD
+	size_t	i;
+#endif
+
+	JSONRPC_THROW(!preallocate_ctx(&self->ctx), return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+#ifdef JSONRPC_HAVE_PTHREAD
+	if (self->batch.threads > 0)
+	{
+		JSONRPC_THROW(!reserve_batch_slots(self, self->steady.limits.batch), return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+		for (i = 0 ; i < self->batch.alloc ; i++)	// a call may take the whole response
+		{
+			JSONRPC_THROW(jsonrpc_mstream_reserve(self->batch.slots[i], self->steady.limits.response) == NULL
+				, return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY
+			);
+		}
+		for (i = 0 ; i < self->batch.threads ; i++)
+		{
+			JSONRPC_THROW(!preallocate_ctx(&self->batch.workers[i].ctx), return JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+		}
+	}
+#endif
+	return JSONRPC_ERROR_OK;
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t set_option (jsonrpc_server_t *self, jsonrpc_option_t option, long value)
+{
+#ifdef JSONRPC_HAVE_PTHREAD
+	size_t	i;
+#endif
+
+	switch (option)
+	{
+	case JSONRPC_OPTION_BATCH_THREADS:
+		JSONRPC_THROW(value < 0, return JSONRPC_ERROR_INVALID_PARAMS);
+#ifdef JSONRPC_HAVE_PTHREAD
+		JSONRPC_THROW(!start_batch_workers(self, (size_t)value), return JSONRPC_ERROR_SERVER_INTERNAL);
+		return JSONRPC_ERROR_OK;
+#else
+		return value == 0 ? JSONRPC_ERROR_OK : JSONRPC_ERROR_SERVER_INTERNAL;	// no thread support
+#endif
+
+	case JSONRPC_OPTION_BATCH_SPLIT:
+		JSONRPC_THROW(value < 0, return JSONRPC_ERROR_INVALID_PARAMS);
+		self->batch.split = (size_t)value;
+		return JSONRPC_ERROR_OK;
+
+	case JSONRPC_OPTION_ARENA_HUGEPAGE:
+		self->arena_flags = value ? JSONRPC_ARENA_HUGEPAGE : 0;
+		if (self->ctx.arena)	// reopened with the new flags
+		{
+			jsonrpc_arena_close(self->ctx.arena);
+			self->ctx.arena = NULL;
+		}
+#ifdef JSONRPC_HAVE_PTHREAD
+		for (i = 0 ; i < self->batch.threads ; i++)
+		{
+			if (self->batch.workers[i].ctx.arena)
+			{
+				jsonrpc_arena_close(self->batch.workers[i].ctx.arena);
+				self->batch.workers[i].ctx.arena = NULL;
+			}
+		}
+#endif
+		return JSONRPC_ERROR_OK;
+
+	case JSONRPC_OPTION_TRIM_THRESHOLD:
+		JSONRPC_THROW(value < 0, return JSONRPC_ERROR_INVALID_PARAMS);
+		self->memory.trim = (size_t)value;
+		return JSONRPC_ERROR_OK;
+
+	case JSONRPC_OPTION_MEMORY_LIMIT:
+		JSONRPC_THROW(value < 0, return JSONRPC_ERROR_INVALID_PARAMS);
+		self->meter.limit = (size_t)value;
+		return JSONRPC_ERROR_OK;
+
+	case JSONRPC_OPTION_BATCH_ORDER:
+		JSONRPC_THROW(value != JSONRPC_BATCH_ORDER_REQUEST && value != JSONRPC_BATCH_ORDER_COMPLETION
+			, return JSONRPC_ERROR_INVALID_PARAMS
+		);
+		self->batch.order = (jsonrpc_batch_order_t)value;
+		return JSONRPC_ERROR_OK;
+
+	default:
+		break;
+	}
+	return JSONRPC_ERROR_INVALID_PARAMS;
+}
+
+typedef struct
+{
+	jsonrpc_server_t	*self;
+	void				*desc;
+	size_t				count;
+} jsonrpc_net_output_t;
+
+JSONRPC_PRIVATE jsonrpc_error_t net_output (void *ctx, const char *data, size_t length, jsonrpc_bool_t more)
+{
+	jsonrpc_net_output_t	*out = (jsonrpc_net_output_t *)ctx;
+
+	out->count++;
+	return out->self->net.send_partial(out->self->net_handle, data, length, more, out->desc);
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t run_server (jsonrpc_server_t *self, unsigned int timeout)
 {
 	jsonrpc_error_t	error;
 	const char *req;
@@ -863,10 +2199,248 @@ jsonrpc_server_run (jsonrpc_server_t *self, unsigned int timeout)
 	if (req == NULL)
 		return JSONRPC_ERROR_SERVER_TIMEOUT;
 
-	res = jsonrpc_server_execute(self, req);
-	JSONRPC_THROW(res == NULL, return JSONRPC_ERROR_SERVER_INTERNAL);
+	if (self->net.sendv && !self->net.send_partial)
+	{
+		const jsonrpc_iovec_t	*iov;
+		size_t					count;
 
-	return self->net.send(self->net_handle, res, desc);
+		count = execute_iov(&self->ctx, req, &iov);
+		JSONRPC_THROW(count == 0, return JSONRPC_ERROR_SERVER_INTERNAL);
+		error = self->net.sendv(self->net_handle, iov, count, desc);
+	}
+	else if (self->net.send_partial)
+	{
+		jsonrpc_net_output_t	out;
+
+		out.self  = self;
+		out.desc  = desc;
+		out.count = 0;
+		error = execute_stream(&self->ctx, req, net_output, &out);
+		JSONRPC_THROW(error == JSONRPC_ERROR_OK && out.count == 0, return JSONRPC_ERROR_SERVER_INTERNAL);
+	}
+	else
+	{
+		res = execute(&self->ctx, req, NULL);
+		JSONRPC_THROW(res == NULL, return JSONRPC_ERROR_SERVER_INTERNAL);
+		error = self->net.send(self->net_handle, res, desc);
+	}
+
+	// the response is out: the memory of the request goes at once
+	recycle_ctx(&self->ctx);
+	return error;
+}
+
+
+
+/*
+ * entry points: the server works with its own allocator
+ */
+
+jsonrpc_server_t *
+jsonrpc_server_open (const jsonrpc_json_plugin_t *ijson, const jsonrpc_net_plugin_t *inet, ...)
+{
+	jsonrpc_server_t	*self;
+	va_list	ap;
+
+	va_start(ap, inet);
+	self = open_server(ijson, inet, ap);
+	va_end(ap);
+	return self;
+}
+
+jsonrpc_server_t *
+jsonrpc_server_open_ex (const jsonrpc_allocator_t *allocator, const jsonrpc_json_plugin_t *ijson, const jsonrpc_net_plugin_t *inet, ...)
+{
+	const jsonrpc_allocator_t	*caller = NULL;
+	jsonrpc_server_t	*self;
+	va_list	ap;
+
+	if (allocator)
+		caller = jsonrpc_set_thread_allocator(allocator);
+	va_start(ap, inet);
+	self = open_server(ijson, inet, ap);
+	va_end(ap);
+	if (allocator)
+		jsonrpc_set_thread_allocator(caller);
+	return self;
+}
+
+void
+jsonrpc_server_close (jsonrpc_server_t *self)
+{
+	jsonrpc_allocator_t	base = self->meter.base;	// where 'self' came from
+
+	JSONRPC_WITH_ALLOCATOR(self, close_server(self));
+	base._free(self, base.userdata);
+}
+
+jsonrpc_error_t
+jsonrpc_server_register_method (
+							jsonrpc_server_t *self
+							, jsonrpc_bool_t has_return
+							, jsonrpc_method_t method
+							, const char *method_name
+							, const char *param_signature
+						)
+{
+	jsonrpc_error_t	err;
+
+	JSONRPC_WITH_ALLOCATOR(self, err = register_method(self, has_return, method, method_name, param_signature));
+	return err;
+}
+
+jsonrpc_error_t
+jsonrpc_server_set_option (jsonrpc_server_t *self, jsonrpc_option_t option, long value)
+{
+	jsonrpc_error_t	err;
+
+	JSONRPC_WITH_ALLOCATOR(self, {
+		err = set_option(self, option, value);
+		if (err == JSONRPC_ERROR_OK && self->steady.on)	// new workers or arenas are sized as well
+			err = preallocate(self);
+	});
+	return err;
+}
+
+jsonrpc_error_t
+jsonrpc_server_preallocate (jsonrpc_server_t *self, const jsonrpc_limits_t *limits)
+{
+	jsonrpc_error_t	err;
+
+	JSONRPC_THROW(limits == NULL, return JSONRPC_ERROR_INVALID_PARAMS);
+
+	self->steady.limits = *limits;
+	JSONRPC_WITH_ALLOCATOR(self, err = preallocate(self));
+	self->steady.on = (err == JSONRPC_ERROR_OK) ? JSONRPC_TRUE : JSONRPC_FALSE;
+	return err;
+}
+
+void
+jsonrpc_server_set_alloc_hook (jsonrpc_server_t *self, jsonrpc_alloc_hook_t hook, void *userdata)
+{
+	self->meter.hook     = hook;
+	self->meter.userdata = userdata;
+}
+
+void
+jsonrpc_server_get_memory_stats (jsonrpc_server_t *self, jsonrpc_memory_stats_t *stats)
+{
+	size_t	bytes[JSONRPC_MEMORY_CLASSES];
+	size_t	i;
+
+	measure_server(self, bytes);
+	for (i = 0 ; i < JSONRPC_MEMORY_CLASSES ; i++)
+	{
+		stats->classes[i].live = bytes[i];
+		stats->classes[i].peak = (self->memory.peak[i] > bytes[i]) ? self->memory.peak[i] : bytes[i];
+	}
+	stats->total.live = jsonrpc_meter_read(&self->meter.live);
+	stats->total.peak = jsonrpc_meter_read(&self->meter.peak);
+	stats->refused    = jsonrpc_meter_read(&self->meter.refused);
+}
+
+jsonrpc_error_t
+jsonrpc_server_run (jsonrpc_server_t *self, unsigned int timeout)
+{
+	jsonrpc_error_t	err;
+
+	JSONRPC_SERVING(self, err = run_server(self, timeout));
+	return err;
+}
+
+const char *
+jsonrpc_server_execute (jsonrpc_server_t *self, const char *request)
+{
+	return jsonrpc_exec_ctx_execute(&self->ctx, request);
+}
+
+jsonrpc_error_t
+jsonrpc_server_execute_stream (jsonrpc_server_t *self, const char *request, jsonrpc_output_t output, void *ctx)
+{
+	return jsonrpc_exec_ctx_execute_stream(&self->ctx, request, output, ctx);
+}
+
+size_t
+jsonrpc_server_execute_into (jsonrpc_server_t *self, const char *request, jsonrpc_buffer_t *out)
+{
+	return jsonrpc_exec_ctx_execute_into(&self->ctx, request, out);
+}
+
+size_t
+jsonrpc_server_execute_iov (jsonrpc_server_t *self, const char *request, const jsonrpc_iovec_t **iov)
+{
+	return jsonrpc_exec_ctx_execute_iov(&self->ctx, request, iov);
+}
+
+jsonrpc_arena_t *
+jsonrpc_server_get_arena (jsonrpc_server_t *self)
+{
+	return jsonrpc_exec_ctx_get_arena(&self->ctx);
+}
+
+jsonrpc_exec_ctx_t *
+jsonrpc_exec_ctx_open (jsonrpc_server_t *server)
+{
+	jsonrpc_exec_ctx_t	*self;
+
+	JSONRPC_THROW(server == NULL, return NULL);
+
+	JSONRPC_WITH_ALLOCATOR(server, self = open_exec_ctx(server));
+	return self;
+}
+
+void
+jsonrpc_exec_ctx_close (jsonrpc_exec_ctx_t *self)
+{
+	if (self == NULL)
+		return;
+	JSONRPC_WITH_ALLOCATOR(self->server, {
+		clear_exec_ctx(self);
+		jsonrpc_free(self);
+	});
+}
+
+jsonrpc_arena_t *
+jsonrpc_exec_ctx_get_arena (jsonrpc_exec_ctx_t *self)
+{
+	jsonrpc_arena_t	*arena;
+
+	JSONRPC_WITH_ALLOCATOR(self->server, arena = get_arena(self));
+	return arena;
 }
 
+const char *
+jsonrpc_exec_ctx_execute (jsonrpc_exec_ctx_t *self, const char *request)
+{
+	const char	*response;
 
+	JSONRPC_SERVING(self->server, response = execute(self, request, NULL));
+	return response;
+}
+
+jsonrpc_error_t
+jsonrpc_exec_ctx_execute_stream (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_output_t output, void *ctx)
+{
+	jsonrpc_error_t	err;
+
+	JSONRPC_SERVING(self->server, err = execute_stream(self, request, output, ctx));
+	return err;
+}
+
+size_t
+jsonrpc_exec_ctx_execute_into (jsonrpc_exec_ctx_t *self, const char *request, jsonrpc_buffer_t *out)
+{
+	size_t	length;
+
+	JSONRPC_SERVING(self->server, length = execute_into(self, request, out));
+	return length;
+}
+
+size_t
+jsonrpc_exec_ctx_execute_iov (jsonrpc_exec_ctx_t *self, const char *request, const jsonrpc_iovec_t **iov)
+{
+	size_t	count;
+
+	JSONRPC_SERVING(self->server, count = execute_iov(self, request, iov));
+	return count;
+}
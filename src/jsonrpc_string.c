@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "jsonrpc_string.h"
+#include "jsonrpc_utf8.h"
+#include "jsonrpc_macro.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(JSONRPC_SIMD_SCALAR)
+#define	JSONRPC_ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+
+#define	JSONRPC_IS_DIGIT(c)	((c) >= '0' && (c) <= '9')
+#define	JSONRPC_SCAN_MAX_DEPTH	512
+
+#define	JSONRPC_SCAN_BRACKET	1	///< { } [ ]
+#define	JSONRPC_SCAN_STRING		2	///< " \\ (stops a scan inside a string)
+#define	JSONRPC_SCAN_DELIMITER	4	///< ends a scalar
+
+static const unsigned char	scan_table[256] = {
+	  ['{']  = JSONRPC_SCAN_BRACKET | JSONRPC_SCAN_DELIMITER
+	, ['}']  = JSONRPC_SCAN_BRACKET | JSONRPC_SCAN_DELIMITER
+	, ['[']  = JSONRPC_SCAN_BRACKET | JSONRPC_SCAN_DELIMITER
+	, [']']  = JSONRPC_SCAN_BRACKET | JSONRPC_SCAN_DELIMITER
+	, ['"']  = JSONRPC_SCAN_BRACKET | JSONRPC_SCAN_STRING | JSONRPC_SCAN_DELIMITER
+	, ['\\'] = JSONRPC_SCAN_STRING
+	, [',']  = JSONRPC_SCAN_DELIMITER
+	, [':']  = JSONRPC_SCAN_DELIMITER
+	, [' ']  = JSONRPC_SCAN_DELIMITER
+	, ['\t'] = JSONRPC_SCAN_DELIMITER
+	, ['\n'] = JSONRPC_SCAN_DELIMITER
+	, ['\r'] = JSONRPC_SCAN_DELIMITER
+};
+
+#define	JSONRPC_SCAN(p, end, kind)	\
+	while ((p) < (end) && !(scan_table[(unsigned char)*(p)] & (kind))) (p)++
+
+#define	JSONRPC_NEEDS_ESCAPE(c)	((unsigned char)(c) < 0x20 || (c) == '"' || (c) == '\\')
+
+typedef size_t (* jsonrpc_escape_span_t) (const char *str, size_t length);
+
+
+JSONRPC_PRIVATE jsonrpc_bool_t parse_hex4 (const char *s, unsigned long *code)
+{
+	int	i;
+
+	for (*code = 0, i = 0 ; i < 4 ; i++, s++)
+	{
+		*code <<= 4;
+		if (JSONRPC_IS_DIGIT(*s))
+			*code |= (unsigned long)(*s - '0');
+		else if (*s >= 'a' && *s <= 'f')
+			*code |= (unsigned long)(*s - 'a' + 10);
+		else if (*s >= 'A' && *s <= 'F')
+			*code |= (unsigned long)(*s - 'A' + 10);
+		else
+			return JSONRPC_FALSE;
+	}
+	return JSONRPC_TRUE;
+}
+
+JSONRPC_PRIVATE char * encode_utf8 (char *d, unsigned long code)
+{
+	if (code < 0x80)
+	{
+		*d++ = (char)code;
+	}
+	else if (code < 0x800)
+	{
+		*d++ = (char)(0xC0 | (code >> 6));
+		*d++ = (char)(0x80 | (code & 0x3F));
+	}
+	else if (code < 0x10000)
+	{
+		*d++ = (char)(0xE0 | (code >> 12));
+		*d++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*d++ = (char)(0x80 | (code & 0x3F));
+	}
+	else
+	{
+		*d++ = (char)(0xF0 | (code >> 18));
+		*d++ = (char)(0x80 | ((code >> 12) & 0x3F));
+		*d++ = (char)(0x80 | ((code >> 6) & 0x3F));
+		*d++ = (char)(0x80 | (code & 0x3F));
+	}
+	return d;
+}
+
+
+char *	jsonrpc_string_unescape (char *str, size_t *length)
+{
+	char	*s, *d;
+	unsigned long	code, low;
+	size_t	n;
+
+	d = s = str;
+	for (;;)
+	{
+		if (*s == '"')
+			break;
+		if ((unsigned char)*s < 0x20)
+			return NULL;	// control character or end of input
+		if ((unsigned char)*s >= 0x80)
+		{
+			// the terminating '\0' stops a truncated sequence, as it is no continuation byte
+			JSONRPC_THROW((n = jsonrpc_utf8_sequence(s, 4)) == 0, return NULL);
+			while (n--)
+				*d++ = *s++;
+			continue;
+		}
+		if (*s != '\\')
+		{
+			*d++ = *s++;
+			continue;
+		}
+
+		s++;
+		switch (*s++)
+		{
+		case '"':  *d++ = '"';  break;
+		case '\\': *d++ = '\\'; break;
+		case '/':  *d++ = '/';  break;
+		case 'b':  *d++ = '\b'; break;
+		case 'f':  *d++ = '\f'; break;
+		case 'n':  *d++ = '\n'; break;
+		case 'r':  *d++ = '\r'; break;
+		case 't':  *d++ = '\t'; break;
+		case 'u':
+			JSONRPC_THROW(!parse_hex4(s, &code), return NULL);
+			s += 4;
+			if (code >= 0xD800 && code <= 0xDBFF)	// surrogate pair
+			{
+				JSONRPC_THROW(s[0] != '\\' || s[1] != 'u' || !parse_hex4(s + 2, &low) || low < 0xDC00 || low > 0xDFFF
+					, return NULL
+				);
+				s += 6;
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			}
+			else
+			{
+				JSONRPC_THROW(code >= 0xDC00 && code <= 0xDFFF, return NULL);
+			}
+			d = encode_utf8(d, code);
+			break;
+
+		default:
+			return NULL;
+		}
+	}
+	*d = '\0';
+	if (length)
+		*length = (size_t)(d - str);
+	return s + 1;
+}
+
+const char *	jsonrpc_string_skip_value (const char *str, const char *end)
+{
+	char		close[JSONRPC_SCAN_MAX_DEPTH];	///< expected closing bracket of each level
+	int			depth = 0;
+	const char	*p = str;
+
+	if (p < end && !(scan_table[(unsigned char)*p] & JSONRPC_SCAN_BRACKET))	// scalar
+	{
+		JSONRPC_SCAN(p, end, JSONRPC_SCAN_DELIMITER);
+		return (p == str) ? NULL : p;
+	}
+
+	while (p < end)
+	{
+		switch (*p++)
+		{
+		case '"':
+			for (;;)
+			{
+				JSONRPC_SCAN(p, end, JSONRPC_SCAN_STRING);
+				JSONRPC_THROW(p >= end, return NULL);
+				if (*p++ == '"')
+					break;
+				p++;	// escaped character
+			}
+			break;
+
+		case '{':
+		case '[':
+			JSONRPC_THROW(depth >= JSONRPC_SCAN_MAX_DEPTH, return NULL);
+			close[depth++] = (p[-1] == '{') ? '}' : ']';
+			break;
+
+		case '}':
+		case ']':
+			JSONRPC_THROW(depth == 0 || close[depth - 1] != p[-1], return NULL);
+			depth--;
+			break;
+
+		default:
+			JSONRPC_SCAN(p, end, JSONRPC_SCAN_BRACKET);
+			continue;
+		}
+		if (depth == 0)
+			return p;
+	}
+	return NULL;
+}
+
+
+JSONRPC_PRIVATE size_t escape_span_scalar (const char *str, size_t length)
+{
+	const uint64_t	ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+	uint64_t	w, q, b;
+	size_t		i = 0;
+
+	for ( ; i + 8 <= length ; i += 8)	// a word at a time while clean
+	{
+		memcpy(&w, str + i, sizeof(w));
+		q = w ^ (ones * '"');
+		b = w ^ (ones * '\\');
+		if ((((w - ones * 0x20) & ~w) | ((q - ones) & ~q) | ((b - ones) & ~b)) & highs)
+			break;
+	}
+	for ( ; i < length && !JSONRPC_NEEDS_ESCAPE(str[i]) ; i++)
+		;
+	return i;
+}
+
+#ifdef JSONRPC_ESCAPE_X86
+JSONRPC_PRIVATE size_t escape_span_sse2 (const char *str, size_t length)
+{
+	const __m128i	control = _mm_set1_epi8(0x1F);
+	const __m128i	quote   = _mm_set1_epi8('"');
+	const __m128i	bslash  = _mm_set1_epi8('\\');
+	__m128i	v, m;
+	int		mask;
+	size_t	i;
+
+	for (i = 0 ; i + 16 <= length ; i += 16)
+	{
+		v = _mm_loadu_si128((const __m128i *)(str + i));
+		m = _mm_cmpeq_epi8(_mm_max_epu8(v, control), control);	// v <= 0x1F
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, quote));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bslash));
+		if ((mask = _mm_movemask_epi8(m)) != 0)
+			return i + (size_t)__builtin_ctz((unsigned int)mask);
+	}
+	return i + escape_span_scalar(str + i, length - i);
+}
+
+__attribute__((target("avx2")))
+JSONRPC_PRIVATE size_t escape_span_avx2 (const char *str, size_t length)
+{
+	const __m256i	control = _mm256_set1_epi8(0x1F);
+	const __m256i	quote   = _mm256_set1_epi8('"');
+	const __m256i	bslash  = _mm256_set1_epi8('\\');
+	__m256i	v, m;
+	unsigned int	mask;
+	size_t	i;
+
+	for (i = 0 ; i + 32 <= length ; i += 32)
+	{
+		v = _mm256_loadu_si256((const __m256i *)(str + i));
+		m = _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control);	// v <= 0x1F
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, quote));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, bslash));
+		if ((mask = (unsigned int)_mm256_movemask_epi8(m)) != 0)
+			return i + (size_t)__builtin_ctz(mask);
+	}
+	return i + escape_span_sse2(str + i, length - i);
+}
+#endif
+
+JSONRPC_PRIVATE jsonrpc_escape_span_t select_escape_span (void)
+{
+#ifdef JSONRPC_ESCAPE_X86
+	static jsonrpc_escape_span_t	selected;	///< shared by all the threads: atomic accesses only
+	jsonrpc_escape_span_t	span;
+
+	if ((span = __atomic_load_n(&selected, __ATOMIC_ACQUIRE)) == NULL)
+	{
+		__builtin_cpu_init();
+		span = __builtin_cpu_supports("avx2") ? escape_span_avx2 : escape_span_sse2;
+		__atomic_store_n(&selected, span, __ATOMIC_RELEASE);	// threads racing here all store the same one
+	}
+	return span;
+#else
+	return escape_span_scalar;
+#endif
+}
+
+size_t	jsonrpc_string_escape_span (const char *str, size_t length)
+{
+	if (length < 16)
+		return escape_span_scalar(str, length);
+	return select_escape_span()(str, length);
+}
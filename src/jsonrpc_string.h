@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#ifndef jsonrpc_jsonrpc_string_h
+#define jsonrpc_jsonrpc_string_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Unescape a JSON string in place.
+ * 'str' points just after the opening quote. The unescaped string is never longer
+ * than the escaped one, so it is written over itself and '\0' terminated
+ * where the closing quote was at the latest.
+ * If 'length' is not NULL, it receives the byte length of the unescaped string
+ * (which may contain '\0' from "\u0000").
+ *
+ * @return pointer just past the closing quote, or NULL if the string is invalid
+ *         (malformed UTF-8 included)
+ */
+char *	jsonrpc_string_unescape (char *str, size_t *length);
+
+/**
+ * Find the end of the JSON value starting at 'str', without parsing it.
+ * Only strings and the nesting of brackets are checked; everything else is
+ * left to the parser of the value.
+ *
+ * @return pointer just past the value, or NULL if a string or bracket is not closed
+ */
+const char *	jsonrpc_string_skip_value (const char *str, const char *end);
+
+/**
+ * Count the bytes at the start of 'str' that go into a JSON string as they are,
+ * that is up to the first quote, backslash or control character.
+ *
+ * @return number of bytes (== 'length' if nothing in 'str' needs an escape)
+ */
+size_t	jsonrpc_string_escape_span (const char *str, size_t length);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "jsonrpc_utf8.h"
+#include "jsonrpc_macro.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(JSONRPC_SIMD_SCALAR)
+#define	JSONRPC_UTF8_AVX2
+#include <immintrin.h>
+#endif
+
+#define	JSONRPC_UTF8_IS_CONT(c)		(((c) & 0xC0) == 0x80)
+
+typedef jsonrpc_bool_t (* jsonrpc_utf8_validate_t) (const unsigned char *s, size_t n);
+
+
+JSONRPC_PRIVATE size_t sequence_length (const unsigned char *s, size_t n)
+{
+	unsigned char	c = *s;
+
+	if (c < 0x80)
+		return 1;
+	if (c >= 0xC2 && c <= 0xDF)
+	{
+		JSONRPC_THROW(n < 2 || !JSONRPC_UTF8_IS_CONT(s[1]), return 0);
+		return 2;
+	}
+	if (c >= 0xE0 && c <= 0xEF)
+	{
+		JSONRPC_THROW(n < 3 || !JSONRPC_UTF8_IS_CONT(s[1]) || !JSONRPC_UTF8_IS_CONT(s[2]), return 0);
+		JSONRPC_THROW(c == 0xE0 && s[1] < 0xA0, return 0);	// overlong
+		JSONRPC_THROW(c == 0xED && s[1] > 0x9F, return 0);	// surrogate
+		return 3;
+	}
+	if (c >= 0xF0 && c <= 0xF4)
+	{
+		JSONRPC_THROW(n < 4 || !JSONRPC_UTF8_IS_CONT(s[1]) || !JSONRPC_UTF8_IS_CONT(s[2]) || !JSONRPC_UTF8_IS_CONT(s[3])
+			, return 0
+		);
+		JSONRPC_THROW(c == 0xF0 && s[1] < 0x90, return 0);	// overlong
+		JSONRPC_THROW(c == 0xF4 && s[1] > 0x8F, return 0);	// above U+10FFFF
+		return 4;
+	}
+	return 0;
+}
+
+JSONRPC_PRIVATE jsonrpc_bool_t validate_scalar (const unsigned char *s, size_t n)
+{
+	const unsigned char	*end = s + n;
+	uint64_t	word;
+	size_t		len;
+
+	while (s < end)
+	{
+		if (end - s >= 8)	// skip ASCII a word at a time
+		{
+			memcpy(&word, s, sizeof(word));
+			if ((word & 0x8080808080808080ULL) == 0)
+			{
+				s += 8;
+				continue;
+			}
+		}
+
+		JSONRPC_THROW((len = sequence_length(s, (size_t)(end - s))) == 0, return JSONRPC_FALSE);
+		s += len;
+	}
+	return JSONRPC_TRUE;
+}
+
+#ifdef JSONRPC_UTF8_AVX2
+/*
+ * Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+ * Every error is a property of a byte and the up to three bytes before it: the high
+ * nibble of the previous byte, its low nibble and the high nibble of the current byte
+ * each select a set of possible errors from a table; a real error is in all three.
+ * The length checks (continuations expected after 3 and 4 byte leads) are added on top.
+ */
+#define	JSONRPC_UTF8_TOO_SHORT		(1 << 0)
+#define	JSONRPC_UTF8_TOO_LONG		(1 << 1)
+#define	JSONRPC_UTF8_OVERLONG_3		(1 << 2)
+#define	JSONRPC_UTF8_TOO_LARGE		(1 << 3)
+#define	JSONRPC_UTF8_SURROGATE		(1 << 4)
+#define	JSONRPC_UTF8_OVERLONG_2		(1 << 5)
+#define	JSONRPC_UTF8_TOO_LARGE_1000	(1 << 6)
+#define	JSONRPC_UTF8_OVERLONG_4		(1 << 6)
+#define	JSONRPC_UTF8_TWO_CONTS		(1 << 7)
+#define	JSONRPC_UTF8_CARRY			(JSONRPC_UTF8_TOO_SHORT | JSONRPC_UTF8_TOO_LONG | JSONRPC_UTF8_TWO_CONTS)
+
+#define	JSONRPC_UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)	\
+	_mm256_setr_epi8(\
+		(char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h),\
+		(char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p),\
+		(char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h),\
+		(char)(i), (char)(j), (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p))
+
+/**
+ * 'input' shifted right by n bytes, with the last bytes of 'prev' shifted in
+ */
+#define	JSONRPC_UTF8_PREV(input, prev, n)	\
+	_mm256_alignr_epi8((input), _mm256_permute2x128_si256((prev), (input), 0x21), 16 - (n))
+
+__attribute__((target("avx2")))
+JSONRPC_PRIVATE __m256i check_block (__m256i input, __m256i prev_input)
+{
+	const __m256i	nibble = _mm256_set1_epi8(0x0F);
+	const __m256i	byte_1_high_table = JSONRPC_UTF8_TABLE(
+		// 0_______ ________ <ASCII in byte 1>
+		JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG,
+		JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG, JSONRPC_UTF8_TOO_LONG,
+		// 10______ ________ <continuation in byte 1>
+		JSONRPC_UTF8_TWO_CONTS, JSONRPC_UTF8_TWO_CONTS, JSONRPC_UTF8_TWO_CONTS, JSONRPC_UTF8_TWO_CONTS,
+		// 1100____ ________ <two byte lead in byte 1>
+		JSONRPC_UTF8_TOO_SHORT | JSONRPC_UTF8_OVERLONG_2,
+		// 1101____ ________ <two byte lead in byte 1>
+		JSONRPC_UTF8_TOO_SHORT,
+		// 1110____ ________ <three byte lead in byte 1>
+		JSONRPC_UTF8_TOO_SHORT | JSONRPC_UTF8_OVERLONG_3 | JSONRPC_UTF8_SURROGATE,
+		// 1111____ ________ <four+ byte lead in byte 1>
+		JSONRPC_UTF8_TOO_SHORT | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000 | JSONRPC_UTF8_OVERLONG_4
+	);
+	const __m256i	byte_1_low_table = JSONRPC_UTF8_TABLE(
+		// ____0000 ________
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_OVERLONG_3 | JSONRPC_UTF8_OVERLONG_2 | JSONRPC_UTF8_OVERLONG_4,
+		// ____0001 ________
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_OVERLONG_2,
+		// ____001_ ________
+		JSONRPC_UTF8_CARRY,
+		JSONRPC_UTF8_CARRY,
+		// ____0100 ________
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE,
+		// ____0101 ________ and above
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		// ____1101 ________
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000 | JSONRPC_UTF8_SURROGATE,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000,
+		JSONRPC_UTF8_CARRY | JSONRPC_UTF8_TOO_LARGE | JSONRPC_UTF8_TOO_LARGE_1000
+	);
+	const __m256i	byte_2_high_table = JSONRPC_UTF8_TABLE(
+		// ________ 0_______ <ASCII in byte 2>
+		JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT,
+		JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT,
+		// ________ 1000____
+		JSONRPC_UTF8_TOO_LONG | JSONRPC_UTF8_OVERLONG_2 | JSONRPC_UTF8_TWO_CONTS | JSONRPC_UTF8_OVERLONG_3 | JSONRPC_UTF8_TOO_LARGE_1000 | JSONRPC_UTF8_OVERLONG_4,
+		// ________ 1001____
+		JSONRPC_UTF8_TOO_LONG | JSONRPC_UTF8_OVERLONG_2 | JSONRPC_UTF8_TWO_CONTS | JSONRPC_UTF8_OVERLONG_3 | JSONRPC_UTF8_TOO_LARGE,
+		// ________ 101_____
+		JSONRPC_UTF8_TOO_LONG | JSONRPC_UTF8_OVERLONG_2 | JSONRPC_UTF8_TWO_CONTS | JSONRPC_UTF8_SURROGATE | JSONRPC_UTF8_TOO_LARGE,
+		JSONRPC_UTF8_TOO_LONG | JSONRPC_UTF8_OVERLONG_2 | JSONRPC_UTF8_TWO_CONTS | JSONRPC_UTF8_SURROGATE | JSONRPC_UTF8_TOO_LARGE,
+		// ________ 11______
+		JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT, JSONRPC_UTF8_TOO_SHORT
+	);
+	__m256i	prev1, prev2, prev3, byte_1_high, byte_1_low, byte_2_high, special, must23;
+
+	prev1 = JSONRPC_UTF8_PREV(input, prev_input, 1);
+	prev2 = JSONRPC_UTF8_PREV(input, prev_input, 2);
+	prev3 = JSONRPC_UTF8_PREV(input, prev_input, 3);
+
+	byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+	byte_1_low  = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+	byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+	special     = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+	// third and fourth bytes of 3 and 4 byte sequences must be continuations
+	must23 = _mm256_or_si256(
+				  _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)))
+				, _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)))
+			);
+	must23 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+	return _mm256_xor_si256(must23, special);
+}
+
+__attribute__((target("avx2")))
+JSONRPC_PRIVATE jsonrpc_bool_t validate_avx2 (const unsigned char *s, size_t n)
+{
+	const __m256i	incomplete_max = _mm256_setr_epi8(
+		(char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+		(char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+		(char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+		(char)255, (char)255, (char)255, (char)255, (char)255, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)
+	);
+	__m256i	input, prev_input, error, incomplete;
+	unsigned char	tail[32];
+	size_t	i;
+
+	prev_input = _mm256_setzero_si256();
+	error      = _mm256_setzero_si256();
+	incomplete = _mm256_setzero_si256();
+	for (i = 0 ; i < n ; i += 32)
+	{
+		if (n - i >= 32)
+			input = _mm256_loadu_si256((const __m256i *)(s + i));
+		else
+		{
+			memset(tail, 0, sizeof(tail));	// padded with ASCII, which ends any sequence
+			memcpy(tail, s + i, n - i);
+			input = _mm256_loadu_si256((const __m256i *)tail);
+		}
+
+		if (_mm256_movemask_epi8(input) == 0)	// ASCII: only a sequence left open is an error
+			error = _mm256_or_si256(error, incomplete);
+		else
+		{
+			error      = _mm256_or_si256(error, check_block(input, prev_input));
+			incomplete = _mm256_subs_epu8(input, incomplete_max);
+		}
+		prev_input = input;
+	}
+	error = _mm256_or_si256(error, incomplete);
+	return _mm256_testz_si256(error, error) ? JSONRPC_TRUE : JSONRPC_FALSE;
+}
+#endif
+
+JSONRPC_PRIVATE jsonrpc_utf8_validate_t select_validate (void)
+{
+#ifdef JSONRPC_UTF8_AVX2
+	static jsonrpc_utf8_validate_t	selected;	///< shared by all the threads: atomic accesses only
+	jsonrpc_utf8_validate_t	validate;
+
+	if ((validate = __atomic_load_n(&selected, __ATOMIC_ACQUIRE)) == NULL)
+	{
+		__builtin_cpu_init();
+		validate = __builtin_cpu_supports("avx2") ? validate_avx2 : validate_scalar;
+		__atomic_store_n(&selected, validate, __ATOMIC_RELEASE);	// threads racing here all store the same one
+	}
+	return validate;
+#else
+	return validate_scalar;
+#endif
+}
+
+
+jsonrpc_bool_t	jsonrpc_utf8_validate (const char *str, size_t length)
+{
+	return select_validate()((const unsigned char *)str, length);
+}
+
+size_t	jsonrpc_utf8_sequence (const char *str, size_t length)
+{
+	return sequence_length((const unsigned char *)str, length);
+}
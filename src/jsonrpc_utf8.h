@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#ifndef jsonrpc_jsonrpc_utf8_h
+#define jsonrpc_jsonrpc_utf8_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Check that 'length' bytes at 'str' are well-formed UTF-8
+ * (no overlong forms, surrogates or code points above U+10FFFF).
+ */
+jsonrpc_bool_t	jsonrpc_utf8_validate (const char *str, size_t length);
+
+/**
+ * Length of the well-formed UTF-8 sequence at 'str' (at most 'length' bytes),
+ * 0 if it is malformed. Parsers call it on the non-ASCII bytes of the strings they scan.
+ */
+size_t	jsonrpc_utf8_sequence (const char *str, size_t length);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
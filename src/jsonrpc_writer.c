@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#include <string.h>
+
+#include "jsonrpc_writer.h"
+#include "jsonrpc_number.h"
+#include "jsonrpc_macro.h"
+
+
+/**
+ * keep the first error
+ */
+JSONRPC_PRIVATE jsonrpc_error_t fail (jsonrpc_writer_t *self, jsonrpc_error_t error)
+{
+	if (self->error == JSONRPC_ERROR_OK)
+		self->error = error;
+	return self->error;
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t put (jsonrpc_writer_t *self, const char *data, size_t length)
+{
+	if (self->stream && jsonrpc_mstream_write(self->stream, data, length) < 0)
+		return fail(self, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+	return self->error;
+}
+
+/**
+ * separate a value from the previous one at the same level
+ */
+JSONRPC_PRIVATE jsonrpc_error_t begin_value (jsonrpc_writer_t *self)
+{
+	uint64_t	bit = (uint64_t)1 << self->depth;
+
+	if (self->error != JSONRPC_ERROR_OK)
+		return self->error;
+
+	if (self->key)
+		self->key = JSONRPC_FALSE;
+	else if (self->object & bit)
+		return fail(self, JSONRPC_ERROR_SERVER_INTERNAL);	// member without a key
+	else if (self->comma & bit)
+	{
+		JSONRPC_THROW(self->depth == 0, return fail(self, JSONRPC_ERROR_SERVER_INTERNAL));	// one result only
+		put(self, ",", 1);
+	}
+	self->comma |= bit;
+	return self->error;
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t begin_container (jsonrpc_writer_t *self, const char *open, jsonrpc_bool_t object)
+{
+	uint64_t	bit;
+
+	JSONRPC_THROW(self->depth + 1 >= JSONRPC_WRITER_DEPTH, return fail(self, JSONRPC_ERROR_SERVER_INTERNAL));
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+
+	bit = (uint64_t)1 << ++self->depth;
+	self->comma &= ~bit;
+	if (object)
+		self->object |= bit;
+	else
+		self->object &= ~bit;
+	return put(self, open, 1);
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t end_container (jsonrpc_writer_t *self, const char *close, jsonrpc_bool_t object)
+{
+	JSONRPC_THROW(self->depth == 0 || self->key || !(self->object >> self->depth & 1) != !object
+		, return fail(self, JSONRPC_ERROR_SERVER_INTERNAL)
+	);
+	if (self->error != JSONRPC_ERROR_OK)
+		return self->error;
+
+	self->depth--;
+	return put(self, close, 1);
+}
+
+JSONRPC_PRIVATE jsonrpc_error_t put_string (jsonrpc_writer_t *self, const char *str, size_t length)
+{
+	if (self->stream && jsonrpc_mstream_write_string(self->stream, str, length) < 0)
+		return fail(self, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+	return self->error;
+}
+
+
+void
+jsonrpc_writer_init (jsonrpc_writer_t *writer, jsonrpc_mstream_t *stream, jsonrpc_arena_t *arena)
+{
+	memset(writer, 0, sizeof(jsonrpc_writer_t));
+	writer->stream = stream;
+	writer->arena  = arena;
+	writer->error  = JSONRPC_ERROR_OK;
+}
+
+jsonrpc_error_t
+jsonrpc_writer_finish (jsonrpc_writer_t *writer)
+{
+	JSONRPC_THROW(writer->depth != 0, return fail(writer, JSONRPC_ERROR_SERVER_INTERNAL));
+	return writer->error;
+}
+
+void
+jsonrpc_writer_print (void *writer, const char *fmt, ...)
+{
+	jsonrpc_writer_t	*self = (jsonrpc_writer_t *)writer;
+	va_list	ap;
+
+	va_start(ap, fmt);
+	if (self->stream && jsonrpc_mstream_vprint(self->stream, fmt, ap) < 0)
+		fail(self, JSONRPC_ERROR_SERVER_OUT_OF_MEMORY);
+	va_end(ap);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_begin_object (jsonrpc_writer_t *self)
+{
+	return begin_container(self, "{", JSONRPC_TRUE);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_end_object (jsonrpc_writer_t *self)
+{
+	return end_container(self, "}", JSONRPC_TRUE);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_begin_array (jsonrpc_writer_t *self)
+{
+	return begin_container(self, "[", JSONRPC_FALSE);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_end_array (jsonrpc_writer_t *self)
+{
+	return end_container(self, "]", JSONRPC_FALSE);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_key (jsonrpc_writer_t *self, const char *name)
+{
+	uint64_t	bit = (uint64_t)1 << self->depth;
+
+	JSONRPC_THROW(!(self->object & bit) || self->key, return fail(self, JSONRPC_ERROR_SERVER_INTERNAL));
+	if (self->error != JSONRPC_ERROR_OK)
+		return self->error;
+
+	if (self->comma & bit)
+		put(self, ",", 1);
+	self->comma |= bit;
+	put_string(self, name, strlen(name));
+	self->key = JSONRPC_TRUE;
+	return put(self, ":", 1);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_number (jsonrpc_writer_t *self, double value)
+{
+	char	buf[JSONRPC_NUMBER_BUF_LEN];
+
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return put(self, buf, jsonrpc_number_print_double(buf, value));
+}
+
+jsonrpc_error_t
+jsonrpc_writer_int64 (jsonrpc_writer_t *self, int64_t value)
+{
+	char	buf[JSONRPC_NUMBER_BUF_LEN];
+
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return put(self, buf, jsonrpc_number_print_integer(buf, value));
+}
+
+jsonrpc_error_t
+jsonrpc_writer_boolean (jsonrpc_writer_t *self, jsonrpc_bool_t value)
+{
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return value ? put(self, "true", 4) : put(self, "false", 5);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_null (jsonrpc_writer_t *self)
+{
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return put(self, "null", 4);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_string (jsonrpc_writer_t *self, const char *str, size_t length)
+{
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return put_string(self, str, length);
+}
+
+jsonrpc_error_t
+jsonrpc_writer_raw (jsonrpc_writer_t *self, const char *json, size_t length)
+{
+	if (begin_value(self) != JSONRPC_ERROR_OK)
+		return self->error;
+	return put(self, json, length);
+}
+
+jsonrpc_arena_t *
+jsonrpc_writer_get_arena (jsonrpc_writer_t *self)
+{
+	return self->arena;
+}
+
+void *
+jsonrpc_writer_alloc (jsonrpc_writer_t *self, size_t size)
+{
+	JSONRPC_THROW(self->arena == NULL, return NULL);
+	return jsonrpc_arena_alloc(self->arena, size);
+}
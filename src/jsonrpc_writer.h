@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012 Jonghyeok Lee <jhlee4bb@gmail.com>
+ *
+ * jsonrpC is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+
+#ifndef jsonrpc_jsonrpc_writer_h
+#define jsonrpc_jsonrpc_writer_h
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "jsonrpc.h"
+#include "jsonrpc_mstream.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#define	JSONRPC_WRITER_DEPTH	64	///< deepest nesting of arrays and objects
+
+struct jsonrpc_writer
+{
+	jsonrpc_mstream_t	*stream;	///< NULL: the result is dropped (notification)
+	jsonrpc_arena_t		*arena;		///< scratch memory of the request (NULL if out of memory)
+	uint64_t			comma;	///< bit per level: a value was written at that level
+	uint64_t			object;	///< bit per level: the level is an object (else an array, or the top)
+	unsigned int		depth;
+	jsonrpc_bool_t		key;	///< a key was just written, its value follows
+	jsonrpc_error_t		error;	///< first error
+};
+
+/**
+ * Start writing a value to the end of 'stream', for a method with the scratch memory 'arena'.
+ */
+void	jsonrpc_writer_init (jsonrpc_writer_t *writer, jsonrpc_mstream_t *stream, jsonrpc_arena_t *arena);
+
+/**
+ * The error of 'writer', or JSONRPC_ERROR_SERVER_INTERNAL if an array or object is left open.
+ */
+jsonrpc_error_t	jsonrpc_writer_finish (jsonrpc_writer_t *writer);
+
+/**
+ * 'print_result' of a method: formatted text to the stream of 'writer' as it is.
+ */
+void	jsonrpc_writer_print (void *writer, const char *fmt, ...);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif